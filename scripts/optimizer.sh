@@ -0,0 +1,24 @@
+#!/bin/sh
+
+# Compares the optimizers of spawned minds by the arena fitness of their best herbivore
+# and carnivore after a budget of simulated steps, averaged over seeds. es updates every
+# 128 spawned deaths, about every 1500 steps, so shorter budgets see few generations.
+# usage: scripts/optimizer.sh [seeds] [budgets] [arena steps]
+
+SEEDS=${1:-4}
+BUDGETS=${2:-"50000 100000 200000"}
+ARENA=${3:-3000}
+BIN=build/nevo-headless
+
+printf "%-9s %8s %12s %12s\n" optimizer steps herbivore carnivore
+for OPT in selector es; do
+	for N in $BUDGETS; do
+		for SEED in $(seq 1 $SEEDS); do
+			$BIN -s $SEED -n $N -p $N -O $OPT -E 1 -w $ARENA -j 1 || exit 1
+		done | awk -v opt=$OPT -v n=$N '
+			$1 == "herbivore" && $2 == "origin" { h += $5; nh += 1 }
+			$1 == "carnivore" && $2 == "origin" { c += $5; nc += 1 }
+			END { printf "%-9s %8d %12.2f %12.2f\n", opt, n, nh ? h/nh : 0, nc ? c/nc : 0 }
+		'
+	done
+done
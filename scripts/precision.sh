@@ -0,0 +1,48 @@
+#!/bin/sh
+
+# Compares population dynamics of the double and float state builds over several seeds.
+# Runs diverge quickly either way, so the ensembles are compared, not single trajectories.
+# The float build only emulates single precision, its time is not a speedup measure.
+# usage: scripts/precision.sh [seeds] [steps] [period]
+
+SEEDS=${1:-8}
+STEPS=${2:-20000}
+PERIOD=${3:-500}
+OUT=build/precision
+
+mkdir -p $OUT
+for MODE in double float; do
+	BIN=build/nevo-headless
+	[ $MODE = float ] && BIN=build/nevo-headless-float
+	START=$(date +%s.%N)
+	for SEED in $(seq 1 $SEEDS); do
+		$BIN -s $SEED -n $STEPS -p $PERIOD -d $OUT/$MODE-$SEED.csv > /dev/null || exit 1
+	done
+	echo "$MODE: $(awk "BEGIN { print $(date +%s.%N) - $START }") s"
+done
+
+awk -F, '
+	# comment, header and initial row
+	FNR <= 3 { next }
+	{
+		split(FILENAME, p, "/"); split(p[3], q, "-"); m = q[1]; s = q[2] + 0
+		for(i = 2; i <= 4; ++i) { sum[m, i, s] += $i; n[m, i, s] += 1; last[m, i, s] = $i }
+	}
+	END {
+		split("plants herbivores carnivores", names, " ")
+		printf "%-11s %22s %22s %9s %12s\n", "species", "double mean (sd)", "float mean (sd)", "diff", "extinct d/f"
+		for(i = 2; i <= 4; ++i) {
+			for(k = 1; k <= 2; ++k) {
+				m = k == 1 ? "double" : "float"
+				a = 0; b = 0; c = 0; e[k] = 0
+				for(s = 1; s <= '$SEEDS'; ++s) {
+					x = sum[m, i, s]/n[m, i, s]; a += x; b += x*x; c += 1
+					if(last[m, i, s] == 0) e[k] += 1
+				}
+				mean[k] = a/c; sd[k] = sqrt(b/c - mean[k]*mean[k] > 0 ? b/c - mean[k]*mean[k] : 0)
+			}
+			d = mean[1] > 0 ? 100*(mean[2] - mean[1])/mean[1] : 0
+			printf "%-11s %12.1f (%7.1f) %12.1f (%7.1f) %8.1f%% %6d/%d\n", names[i - 1], mean[1], sd[1], mean[2], sd[2], d, e[1], e[2]
+		}
+	}
+' $OUT/double-*.csv $OUT/float-*.csv
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# Regression check of the fast paths: runs each configuration next to the reference world
+# and fails at the first divergence. The plant field is made exact, its approximation is
+# the only fast path allowed to differ from the reference.
+# usage: scripts/shadow.sh [steps] [tolerance]
+
+STEPS=${1:-3000}
+TOL=${2:-1e-9}
+BIN=build/nevo-headless
+
+STATUS=0
+while read -r ARGS; do
+	if $BIN $ARGS -F 0 -n $STEPS -p $STEPS -V $TOL > /dev/null; then
+		echo "ok      $ARGS"
+	else
+		echo "FAILED  $ARGS"
+		STATUS=1
+	fi
+done <<EOF
+-s 1
+-s 2 -T 4
+-s 3 -e 8
+-s 4 -a 0.05 -T 3
+-s 5 -m 3 -c 4 -e 4 -T 2
+-s 6 -K 2 -a 0.05
+EOF
+exit $STATUS
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+// Paces a loop to a target rate by telling it how long to wait before its next iteration;
+// the loop does the waiting, so the governor never blocks inside a callback. Deadlines
+// advance by whole periods, so sleep overshoot does not accumulate; a loop that falls
+// behind by more than a period starts over from the current time instead of bursting to
+// catch up.
+class Governor {
+private:
+	typedef std::chrono::steady_clock Clock;
+	
+	Clock::time_point next, last;
+	bool started = false;
+
+public:
+	// target iterations per second, zero for no limit; may be changed from another thread
+	std::atomic<double> rate;
+	
+	// achieved iterations per second, smoothed; may be read from another thread
+	std::atomic<double> measured;
+	double smoothing = 5e-2;
+	
+	Governor(double r = 0.0) : rate(r), measured(0.0) {}
+	
+	// called once per iteration, seconds from now until the next one is due
+	double delay() {
+		double r = rate;
+		Clock::time_point now = Clock::now(), start = now;
+		if(r > 0.0) {
+			Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0/r));
+			if(!started || now > next + period) {
+				next = now;
+			}
+			start = std::max(now, next);
+			next += period;
+		}
+		
+		// between the starts of the iterations, as they will run after the wait
+		if(started) {
+			double dt = std::chrono::duration<double>(start - last).count();
+			if(dt > 0.0) {
+				double m = measured;
+				measured = m + smoothing*(1.0/dt - m);
+			}
+		}
+		last = start;
+		started = true;
+		return std::chrono::duration<double>(start - now).count();
+	}
+	
+	// forgets the schedule, e.g. after a pause
+	void reset() {
+		started = false;
+	}
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QWidget>
+#include <QPainter>
+#include <QPolygonF>
+#include <QColor>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <world/series.hpp>
+
+
+// Plot of some series over the whole run: the range of each point as a band and its mean
+// as a line. The level is the finest one holding the history of all the series, so the
+// number of points drawn is bounded however long the run is.
+class Chart : public QWidget {
+private:
+	struct Curve {
+		const Series *series;
+		QColor color;
+		std::vector<Series::Sample> samples;
+	};
+	
+	std::string title;
+	std::vector<Curve> curves;
+	
+	void paintEvent(QPaintEvent *) override {
+		QPainter painter(this);
+		painter.setRenderHint(QPainter::Antialiasing);
+		painter.fillRect(rect(), palette().base());
+		
+		int level = 0;
+		for(const Curve &c : curves) {
+			level = std::max(level, c.series->fit());
+		}
+		size_t n = 0;
+		float lo = 0.0f, hi = 0.0f;
+		for(Curve &c : curves) {
+			c.series->read(level, c.samples);
+			n = std::max(n, c.samples.size());
+			for(const Series::Sample &s : c.samples) {
+				lo = std::min(lo, s.lo);
+				hi = std::max(hi, s.hi);
+			}
+		}
+		if(hi <= lo) {
+			hi = lo + 1.0f;
+		}
+		
+		QRectF area = QRectF(rect()).adjusted(2.0, 16.0, -2.0, -2.0);
+		// the curves end at the right border, the newest point of each is the current one
+		auto x = [&] (size_t i, size_t size) {
+			return area.right() - (n > 1 ? area.width()*double(size - 1 - i)/(n - 1) : 0.0);
+		};
+		auto y = [&] (float v) {
+			return area.bottom() - area.height()*double(v - lo)/(hi - lo);
+		};
+		for(const Curve &c : curves) {
+			size_t size = c.samples.size();
+			if(size == 0) {
+				continue;
+			}
+			QPolygonF band, line;
+			for(size_t i = 0; i < size; ++i) {
+				band << QPointF(x(i, size), y(c.samples[i].hi));
+				line << QPointF(x(i, size), y(c.samples[i].mean));
+			}
+			for(size_t i = size; i-- > 0;) {
+				band << QPointF(x(i, size), y(c.samples[i].lo));
+			}
+			QColor fill = c.color;
+			fill.setAlpha(64);
+			painter.setPen(Qt::NoPen);
+			painter.setBrush(fill);
+			painter.drawPolygon(band);
+			painter.setPen(QPen(c.color, 1.5));
+			painter.setBrush(Qt::NoBrush);
+			painter.drawPolyline(line);
+		}
+		
+		painter.setPen(palette().text().color());
+		painter.drawText(QRectF(rect()).adjusted(2.0, 0.0, -2.0, 0.0), Qt::AlignLeft | Qt::AlignTop, title.c_str());
+		painter.drawText(QRectF(rect()).adjusted(2.0, 0.0, -2.0, 0.0), Qt::AlignRight | Qt::AlignTop, QString::number(hi, 'g', 4));
+	}
+
+public:
+	Chart(const std::string &t) : QWidget(), title(t) {
+		setMinimumHeight(80);
+	}
+	
+	void add(const Series &s, const QColor &color) {
+		curves.push_back(Curve{&s, color, std::vector<Series::Sample>()});
+	}
+};
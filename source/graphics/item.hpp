@@ -4,6 +4,8 @@
 
 #include <la/vec.hpp>
 
+#include <memory.hpp>
+
 #include <world/organism.hpp>
 #include <world/spawn.hpp>
 
@@ -12,6 +14,8 @@
 
 class ItemPlant : public Item {
 public:
+	MemoryCharge memory = MemoryCharge(MEM_SCENE, sizeof(ItemPlant));
+	
 	constexpr static const char *COLOR = "#22CC22";
 	
 	ItemPlant(Plant *p) : Item(p) {
@@ -21,6 +25,8 @@ public:
 
 class ItemAnimal : public Item {
 public:
+	MemoryCharge memory = MemoryCharge(MEM_SCENE, sizeof(ItemAnimal));
+	
 	constexpr static const char 
 		*ACOLOR = "#CCCCCC",
 		*HCOLOR = "#FFFF22",
@@ -51,6 +57,8 @@ public:
 
 class ItemSpawn : public Item {
 public:
+	MemoryCharge memory = MemoryCharge(MEM_SCENE, sizeof(ItemSpawn));
+	
 	ItemSpawn(Spawn *s) : Item(s) {
 		if(dynamic_cast<SpawnAnimal*>(s)) {
 			if(dynamic_cast<SpawnHerbivore*>(s)) {
@@ -9,8 +9,14 @@
 #include <QGroupBox>
 
 #include <string>
+#include <algorithm>
 
+#include <memory.hpp>
 #include <world/myworld.hpp>
+#include <world/series.hpp>
+
+#include "chart.hpp"
+#include "item.hpp"
 
 
 class SidePanel : public QWidget {
@@ -20,27 +26,48 @@ public:
 	// QLabel size_label;
 	QPushButton pause_button;
 	
-	QGroupBox delay_groupbox;
-	QHBoxLayout delay_layout;
-	QLabel delay_label_min, delay_label_max;
-	QSlider delay_slider;
+	// the last position of the rate slider means no limit
+	const int rate_max = 1000;
+	
+	QGroupBox rate_groupbox;
+	QHBoxLayout rate_layout;
+	QLabel rate_label_min, rate_label_max;
+	QSlider rate_slider;
 	
-	QLabel delay_label;
+	QLabel rate_label;
+	QLabel rate_measured;
 	QLabel step_duration;
 	QLabel steps_elapsed;
 	
 	QGroupBox stat_groupbox;
 	QVBoxLayout stat_layout;
 	QLabel count_label;
+	QLabel plant_label;
 	QLabel age_label;
 	QLabel nanc_label;
+	QLabel turnover_label;
 	QLabel cscore_label;
 	QLabel hscore_label;
+	QLabel neighbor_label;
+	QLabel memory_label;
+	
+	// sampled by the simulation thread, read by the charts when they paint
+	Timeline timeline;
+	
+	QGroupBox chart_groupbox;
+	QVBoxLayout chart_layout;
+	Chart count_chart, energy_chart, score_chart, duration_chart;
 	
 	QVBoxLayout layout;
 	
-	SidePanel(MyWorld *w) : QWidget() {
+	SidePanel(MyWorld *w) :
+		QWidget(), timeline(*w),
+		count_chart("Animal count"), energy_chart("Mean energy"),
+		score_chart("Champion score"), duration_chart("Step duration, ms")
+	{
 		world = w;
+		// registered before the simulation thread starts
+		world->listeners.push_back(&timeline);
 		
 		// size_label.setText(("World size: " + std::to_string(int(world->size.x())) + "x" + std::to_string(int(world->size.y()))).c_str());
 		// layout.addWidget(&size_label);
@@ -58,57 +85,109 @@ public:
 		});
 		layout.addWidget(&pause_button);
 		
-		delay_groupbox.setTitle("Delay between steps");
-		
-		delay_slider.setFocusPolicy(Qt::NoFocus);
-		delay_slider.setOrientation(Qt::Horizontal);
-		delay_slider.setMinimum(1);
-		delay_slider.setMaximum(40000);
-		delay_slider.setSliderPosition(world->delay);
-		delay_slider.setTickInterval(10000);
-		delay_slider.setTickPosition(QSlider::TicksBelow);
-		delay_label_min.setText("0");
-		delay_label_max.setText("40 ms");
-		
-		delay_layout.addWidget(&delay_label_min);
-		delay_layout.addWidget(&delay_slider, 1);
-		delay_layout.addWidget(&delay_label_max);
-		delay_groupbox.setLayout(&delay_layout);
-		
-		layout.addWidget(&delay_groupbox);
-		
-		delay_label.setText(("Delay: " + std::to_string(1e-3*world->delay) + " ms").c_str());
-		connect(&delay_slider, &QSlider::sliderMoved, [this] (int p) {
-			world->setDelay(p);
-			delay_label.setText(("Delay: " + std::to_string(1e-3*p) + " ms").c_str());
+		rate_groupbox.setTitle("Steps per second");
+		
+		rate_slider.setFocusPolicy(Qt::NoFocus);
+		rate_slider.setOrientation(Qt::Horizontal);
+		rate_slider.setMinimum(1);
+		rate_slider.setMaximum(rate_max + 1);
+		rate_slider.setSliderPosition(world->governor.rate > 0.0 ? int(world->governor.rate) : rate_max + 1);
+		rate_slider.setTickInterval(250);
+		rate_slider.setTickPosition(QSlider::TicksBelow);
+		rate_label_min.setText("1");
+		rate_label_max.setText("max");
+		
+		rate_layout.addWidget(&rate_label_min);
+		rate_layout.addWidget(&rate_slider, 1);
+		rate_layout.addWidget(&rate_label_max);
+		rate_groupbox.setLayout(&rate_layout);
+		
+		layout.addWidget(&rate_groupbox);
+		
+		set_rate(rate_slider.sliderPosition());
+		connect(&rate_slider, &QSlider::sliderMoved, [this] (int p) {
+			set_rate(p);
 		});
-		layout.addWidget(&delay_label);
+		layout.addWidget(&rate_label);
 		
+		layout.addWidget(&rate_measured);
 		layout.addWidget(&step_duration);
 		layout.addWidget(&steps_elapsed);
 		
 		stat_groupbox.setTitle("Statistics");
 		stat_layout.addWidget(&count_label);
+		stat_layout.addWidget(&plant_label);
 		stat_layout.addWidget(&age_label);
 		stat_layout.addWidget(&nanc_label);
+		stat_layout.addWidget(&turnover_label);
 		stat_layout.addWidget(&hscore_label);
 		stat_layout.addWidget(&cscore_label);
+		stat_layout.addWidget(&neighbor_label);
+		stat_layout.addWidget(&memory_label);
 		stat_groupbox.setLayout(&stat_layout);
 		layout.addWidget(&stat_groupbox);
 		
+		// in the colors of the scene
+		QColor hcolor(ItemAnimal::HCOLOR), ccolor(ItemAnimal::CCOLOR);
+		count_chart.add(timeline[SERIES_HERBIVORES], hcolor);
+		count_chart.add(timeline[SERIES_CARNIVORES], ccolor);
+		energy_chart.add(timeline[SERIES_HERBIVORE_ENERGY], hcolor);
+		energy_chart.add(timeline[SERIES_CARNIVORE_ENERGY], ccolor);
+		score_chart.add(timeline[SERIES_HERBIVORE_CHAMPION], hcolor);
+		score_chart.add(timeline[SERIES_CARNIVORE_CHAMPION], ccolor);
+		duration_chart.add(timeline[SERIES_STEP_DURATION], QColor(0, 0, 200));
+		
+		chart_groupbox.setTitle("History");
+		for(Chart *c : {&count_chart, &energy_chart, &score_chart, &duration_chart}) {
+			chart_layout.addWidget(c);
+		}
+		chart_groupbox.setLayout(&chart_layout);
+		layout.addWidget(&chart_groupbox, 1);
+		
 		layout.addStretch(1);
 		
 		setLayout(&layout);
 	}
+	~SidePanel() {
+		world->listeners.remove(&timeline);
+	}
+	
+	void set_rate(int p) {
+		if(p > rate_max) {
+			world->governor.rate = 0.0;
+			rate_label.setText("Target: unlimited");
+		} else {
+			world->governor.rate = double(p);
+			rate_label.setText(("Target: " + std::to_string(p) + " steps/s").c_str());
+		}
+	}
 	
 	void sync() {
+		rate_measured.setText(("Achieved: " + std::to_string(int(world->governor.measured)) + " steps/s").c_str());
 		step_duration.setText(("Step duration: " + std::to_string(world->step_duration) + " ms").c_str());
 		steps_elapsed.setText(("Steps elapsed: " + std::to_string(world->steps_elapsed)).c_str());
 		
-		// count_label.setText(("Animal count: " + std::to_string(world->anim_count)).c_str());
-		// age_label.setText(("Oldest animal age: " + std::to_string(world->anim_max_age)).c_str());
-		// nanc_label.setText(("Longest animal ancestry: " + std::to_string(world->anim_max_anc)).c_str());
-		hscore_label.setText(("Herbivore champion score: " + std::to_string(world->hsel.max_score)).c_str());
-		cscore_label.setText(("Carnivore champion score: " + std::to_string(world->csel.max_score)).c_str());
+		// published by the step thread, the statistics themselves change under it
+		const Timeline &t = timeline;
+		
+		count_label.setText(("Animal count: " + std::to_string(long(t[SERIES_HERBIVORES].last())) + " + " + std::to_string(long(t[SERIES_CARNIVORES].last()))).c_str());
+		plant_label.setText(("Plant count: " + std::to_string(t.plants.load()) + ", energy " + std::to_string(int(t.plant_energy.load()))).c_str());
+		age_label.setText(("Oldest animal age: " + std::to_string(t.oldest.load())).c_str());
+		nanc_label.setText(("Longest animal ancestry: " + std::to_string(t.ancestry.load())).c_str());
+		turnover_label.setText(("Animal births per step: " + std::to_string(t.birth_rate.load())).c_str());
+		hscore_label.setText(("Herbivore champion score: " + std::to_string(t[SERIES_HERBIVORE_CHAMPION].last())).c_str());
+		cscore_label.setText(("Carnivore champion score: " + std::to_string(t[SERIES_CARNIVORE_CHAMPION].last())).c_str());
+		neighbor_label.setText(("Neighbor list rebuilds per step: " + std::to_string(t.neighbor_rate.load())).c_str());
+		
+		const Memory &mem = Memory::get();
+		std::string text = "Memory: " + std::to_string(int(Memory::bytes_mb(mem.total()))) + " MB";
+		for(int i = 0; i < MEM_TAG_COUNT; ++i) {
+			text += std::string("\n  ") + Memory::name(i) + " " + std::to_string(Memory::bytes_mb(mem.bytes(i))) + (mem.over(i) ? " (over budget)" : "");
+		}
+		memory_label.setText(text.c_str());
+		
+		for(Chart *c : {&count_chart, &energy_chart, &score_chart, &duration_chart}) {
+			c->update();
+		}
 	}
 };
@@ -1,18 +1,48 @@
 #pragma once
 
+#include <atomic>
+
+#include <QTimer>
+#include <QScreen>
+#include <QGuiApplication>
+
+#include <trace.hpp>
+#include <memory.hpp>
+#include <event.hpp>
+
 #include "sidepanel.hpp"
 #include "myscene.hpp"
 
+// view that records its paints in the trace
+class TracedView : public View {
+protected:
+	void paintEvent(QPaintEvent *e) override {
+		TraceSpan ts("paint");
+		View::paintEvent(e);
+	}
+};
+
 class Window : public QWidget {
 public:
 	MyScene scene;
-	View view;
+	TracedView view;
 
 	SidePanel panel;
 
 	QHBoxLayout layout;
 	
-	Window(MyWorld *w) : QWidget(), scene(w), panel(w) {
+	// set by the simulation thread after a step, taken by the next frame; however fast the
+	// simulation runs, at most one sync is pending
+	std::atomic<bool> dirty;
+	// time of the first step not yet synced, while tracing
+	std::atomic<int64_t> posted;
+	QTimer frame_timer;
+	// frames between scene syncs while the scene is over its budget
+	int over_period = 15;
+	int skipped = 0;
+	long dropped = 0;
+	
+	Window(MyWorld *w) : QWidget(), scene(w), panel(w), dirty(false), posted(-1) {
 		view.setScene(&scene);
 		
 		layout.addWidget(&view, 2);
@@ -26,14 +56,58 @@ public:
 		vec2 zv = vec2(view.size().width(), view.size().height())/(2*w->size);
 		float z = zv.x() > zv.y() ? zv.x() : zv.y();
 		view.scale(z, z);
+		
+		// frames are pulled at the display refresh rate
+		double hz = 60.0;
+		if(QScreen *screen = QGuiApplication::primaryScreen()) {
+			if(screen->refreshRate() > 1.0) {
+				hz = screen->refreshRate();
+			}
+		}
+		frame_timer.setTimerType(Qt::PreciseTimer);
+		connect(&frame_timer, &QTimer::timeout, [this] () {
+			frame();
+		});
+		frame_timer.start(int(1e3/hz));
+	}
+	
+	// called by the simulation thread after a step
+	void post() {
+		if(Trace::get().enabled()) {
+			int64_t none = -1;
+			posted.compare_exchange_strong(none, Trace::now());
+		}
+		dirty = true;
+	}
+	
+	void frame() {
+		TraceSpan ts("frame");
+		if(dirty.exchange(false)) {
+			// a scene over its budget syncs only every few frames, fewer items are made for
+			// new organisms; each sync still removes the items of the dead ones, so the scene
+			// gets back under its budget as the world shrinks
+			if(Memory::get().over(MEM_SCENE) && ++skipped < over_period) {
+				dirty = true;
+				dropped += 1;
+			} else {
+				skipped = 0;
+				int64_t p = posted.exchange(-1);
+				if(p >= 0) {
+					Trace::get().record("sync latency", p, Trace::now());
+				}
+				TraceSpan t("scene sync");
+				scene.sync();
+			}
+			TraceSpan t("panel sync");
+			panel.sync();
+		}
 	}
 	
 	virtual bool event(QEvent *event) override {
 		if(event->type() == QEvent::User) {
 			UserEvent *ue = static_cast<UserEvent*>(event);
 			if(ue->utype == SyncEvent::UTYPE) {
-				scene.sync();
-				panel.sync();
+				dirty = true;
 				return true;
 			}
 			return false;
@@ -0,0 +1,486 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <memory>
+
+#include <world/myworld.hpp>
+#include <world/setup.hpp>
+#include <world/replay.hpp>
+#include <world/arena.hpp>
+#include <world/stream.hpp>
+#include <world/recorder.hpp>
+#include <world/es.hpp>
+#include <world/shadow.hpp>
+
+#include "world/random.hpp"
+
+
+struct Options {
+	unsigned seed = 0;
+	long steps = 100000;
+	long report = 1000;
+	
+	std::string log;
+	long keyframe = 10000;
+	
+	std::string lineage;
+	std::string dynamics;
+	double adaptive = 0.0;
+	int eyes = 0;
+	
+	int tiles = 1, clusters = 1;
+	int workers = 1;
+	
+	// relative tolerance of the shadow reference world, 0 for none
+	double shadow = 0.0;
+	double theta = -1.0;
+	double skin = -1.0;
+	
+	std::string optimizer = "selector";
+	double sigma = 0.3;
+	
+	std::string archive;
+	std::string stream;
+	std::string trace;
+	
+	// MB per memory tag, 0 for none
+	double budget[MEM_TAG_COUNT] = {0.0};
+	
+	std::string record;
+	long record_period = 1;
+	double record_fraction = 1.0;
+	
+	int evaluate = 0;
+	int threads = 0;
+	long scenario = 5000;
+	
+	std::string replay;
+	long from = 0, to = -1;
+};
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -s <seed>      random seed\n"
+		"  -n <steps>     number of steps to simulate\n"
+		"  -p <steps>     report period\n"
+		"  -l <file>      write replay log\n"
+		"  -k <steps>     keyframe period of the replay log\n"
+		"  -a <dt>        adaptive timestep up to the given step length\n"
+		"  -e <count>     eye rays per animal\n"
+		"  -m <tiles>     map of tiles x tiles default-sized worlds\n"
+		"  -c <count>     populated tiles of the map\n"
+		"  -T <threads>   threads of the sense, eye ray and move phases\n"
+		"  -V <tol>       step a reference world of the straightforward passes alongside and\n"
+		"                 exit with 1 at the first state differing by more than the tolerance\n"
+		"  -F <theta>     opening angle of the plant field, 0 sums plants exactly as the\n"
+		"                 reference does\n"
+		"  -K <skin>      margin of the contact neighbor lists, 0 queries the chunks every step\n"
+		"  -O <name>      optimizer of spawned minds: selector or es\n"
+		"  -x <sigma>     initial step size of es\n"
+		"  -g <file>      export lineage at exit\n"
+		"  -d <file>      write species counts and energies every report period as csv\n"
+		"  -R <file>      record animal trajectories and events in columnar chunks\n"
+		"  -i <steps>     record every n-th step\n"
+		"  -u <fraction>  share of animals recorded\n"
+		"  -S <name>      publish frames to a shared memory stream for nevo-viewer\n"
+		"  -P <file>      write a timeline of the step phases as Chrome trace json\n"
+		"  -M <tag>=<MB>  memory budget of organisms, minds, selector or recorders; while it is\n"
+		"                 exceeded production pauses, selectors admit no champions or recorders\n"
+		"                 drop steps; budgets of the world are process-wide and take no -V, -E\n"
+		"                 or -l\n"
+		"  -A <file>      seed from and add champions to a hall of fame archive\n"
+		"  -E <count>     score the best champions of each species in the arena at exit,\n"
+		"                 with -A and -n 0 these are the best archived minds\n"
+		"  -j <threads>   arena threads, all cores by default\n"
+		"  -w <steps>     length of an arena scenario\n"
+		"  -r <file>      re-simulate a logged run\n"
+		"  -f <step>      first step of the re-simulated range\n"
+		"  -t <step>      last step of the re-simulated range\n",
+		name
+	);
+}
+
+static bool parse(int argc, char *argv[], Options &opt) {
+	for(int i = 1; i < argc; ++i) {
+		const char *a = argv[i];
+		if(a[0] != '-' || a[1] == '\0' || a[2] != '\0' || i + 1 >= argc) {
+			return false;
+		}
+		const char *v = argv[++i];
+		switch(a[1]) {
+		case 's': opt.seed = unsigned(strtoul(v, nullptr, 10)); break;
+		case 'n': opt.steps = atol(v); break;
+		case 'p': opt.report = atol(v); break;
+		case 'l': opt.log = v; break;
+		case 'k': opt.keyframe = atol(v); break;
+		case 'a': opt.adaptive = atof(v); break;
+		case 'e': opt.eyes = atoi(v); break;
+		case 'm': opt.tiles = atoi(v); break;
+		case 'c': opt.clusters = atoi(v); break;
+		case 'T': opt.workers = atoi(v); break;
+		case 'V': opt.shadow = atof(v); break;
+		case 'F': opt.theta = atof(v); break;
+		case 'K': opt.skin = atof(v); break;
+		case 'O': opt.optimizer = v; break;
+		case 'x': opt.sigma = atof(v); break;
+		case 'g': opt.lineage = v; break;
+		case 'd': opt.dynamics = v; break;
+		case 'S': opt.stream = v; break;
+		case 'P': opt.trace = v; break;
+		case 'M': {
+			const char *eq = strchr(v, '=');
+			int tag = eq != nullptr ? Memory::find(std::string(v, eq).c_str()) : -1;
+			// the scene, the charts and the stream apply no back-pressure here
+			if(tag != MEM_ORGANISMS && tag != MEM_MINDS && tag != MEM_SELECTOR && tag != MEM_RECORDERS) {
+				return false;
+			}
+			opt.budget[tag] = atof(eq + 1);
+			break;
+		}
+		case 'R': opt.record = v; break;
+		case 'i': opt.record_period = atol(v); break;
+		case 'u': opt.record_fraction = atof(v); break;
+		case 'A': opt.archive = v; break;
+		case 'E': opt.evaluate = atoi(v); break;
+		case 'j': opt.threads = atoi(v); break;
+		case 'w': opt.scenario = atol(v); break;
+		case 'r': opt.replay = v; break;
+		case 'f': opt.from = atol(v); break;
+		case 't': opt.to = atol(v); break;
+		default: return false;
+		}
+	}
+	return true;
+}
+
+// whether a budget throttles the world itself, not only a recorder
+static bool throttles(const Options &opt) {
+	return opt.budget[MEM_ORGANISMS] > 0.0 || opt.budget[MEM_MINDS] > 0.0 || opt.budget[MEM_SELECTOR] > 0.0;
+}
+
+static void report(MyWorld &world) {
+	printf("step %ld: entities %d", world.step_index, int(world.entities.size()));
+	if(world.adaptive) {
+		printf(", time %f, dt %f", world.time, world.dt);
+	}
+	printf("\n");
+	world.stats.print(stdout);
+	Memory::get().print(stdout);
+	if(world.throttled > 0) {
+		printf("  budget     production paused for %ld steps\n", world.throttled);
+	}
+	if(world.hsel.refused + world.csel.refused > 0) {
+		printf("  budget     selectors refused %ld deaths\n", world.hsel.refused + world.csel.refused);
+	}
+	Neighbors &nb = world.neighbors;
+	if(nb.updates > 0) {
+		printf("  neighbors  rebuilds %ld in %ld steps (%.3f per step), mean list %.1f, fallbacks %ld\n",
+			nb.rebuilds, nb.updates, nb.rate(), nb.mean(), nb.fallbacks
+		);
+	}
+	Lineage &lg = world.lineage;
+	long hm = lg.mrca(KIND_HERBIVORE), cm = lg.mrca(KIND_CARNIVORE);
+	printf("  lineage    nodes %ld, pruned %ld, herbivore mrca depth %d, carnivore mrca depth %d\n",
+		long(lg.nodes.size()), lg.pruned, hm >= 0 ? lg.depth(hm) : -1, cm >= 0 ? lg.depth(cm) : -1
+	);
+	for(Kind k : {KIND_HERBIVORE, KIND_CARNIVORE}) {
+		auto es = dynamic_cast<const EvolutionStrategy*>(k == KIND_HERBIVORE ? world.hopt : world.copt);
+		if(es != nullptr) {
+			printf("  es         %-10s generation %ld, fitness %.2f, sigma %.4f\n",
+				k == KIND_HERBIVORE ? "herbivore" : "carnivore", es->generation, es->fitness, es->mean_sigma()
+			);
+		}
+	}
+}
+
+// one row of population dynamics, for comparing runs e.g. of float and double state
+static void dynamics(FILE *f, const MyWorld &world) {
+	static const Kind kinds[] = {KIND_PLANT, KIND_HERBIVORE, KIND_CARNIVORE};
+	fprintf(f, "%ld", world.step_index);
+	for(Kind k : kinds) {
+		fprintf(f, ",%ld", world.stats[k].count);
+	}
+	for(Kind k : kinds) {
+		fprintf(f, ",%.3f", world.stats[k].energy);
+	}
+	fprintf(f, "\n");
+}
+
+static void evaluate(const Options &opt, const std::vector<Arena::Candidate> &cands) {
+	Arena arena(4, opt.scenario, 1, opt.threads);
+	arena.sensors.eyes = opt.eyes;
+	std::vector<double> fitness = arena.evaluate(cands);
+	int ns = arena.seeds.size();
+	printf("arena: %d minds, %d scenarios of %ld steps\n", int(cands.size()), ns, arena.steps);
+	for(int i = 0; i < int(cands.size()); ++i) {
+		printf("  %-10s origin %8ld, fitness %10.2f  (", cands[i].kind == KIND_HERBIVORE ? "herbivore" : "carnivore", cands[i].mind->origin, fitness[i]);
+		for(int j = 0; j < ns; ++j) {
+			printf(j ? " %.2f" : "%.2f", arena.scores[i*ns + j]);
+		}
+		printf(")\n");
+	}
+}
+
+static int replay(const Options &opt) {
+	Replay rp(opt.replay.c_str());
+	if(!rp.good()) {
+		fprintf(stderr, "cannot read replay log '%s'\n", opt.replay.c_str());
+		return 1;
+	}
+	// the keyframe restores the sensor layout of the logged world
+	MyWorld world(rp.world_size, opt.workers);
+	if(!rp.seek(&world, opt.from)) {
+		fprintf(stderr, "no keyframe at or before step %ld\n", opt.from);
+		return 1;
+	}
+	printf("seed %u, restored keyframe at step %ld\n", rp.seed, world.step_index);
+	
+	long to = opt.to < 0 ? opt.from : opt.to;
+	while(world.step_index < to) {
+		long next = world.step_index + opt.report;
+		rp.run(next < to ? next : to);
+		report(world);
+	}
+	
+	if(rp.mismatches > 0) {
+		fprintf(stderr, "replay diverged: %ld mismatching events, first at step %ld\n", rp.mismatches, rp.first_mismatch);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	Options opt;
+	if(!parse(argc, argv, opt) || opt.report <= 0 || opt.workers < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	
+	if(!opt.replay.empty()) {
+		return replay(opt);
+	}
+	
+	for(int i = 0; i < MEM_TAG_COUNT; ++i) {
+		Memory::get().budget(i, int64_t(opt.budget[i]*(1 << 20)));
+	}
+	
+	if(!opt.trace.empty()) {
+		Trace::get().name("simulation");
+		Trace::get().start();
+	}
+	
+	if(opt.shadow > 0.0 && (opt.optimizer != "selector" || !opt.archive.empty())) {
+		fprintf(stderr, "the shadow reference runs the selector without an archive\n");
+		return 1;
+	}
+	// The budgets are process-wide: a throttled world depends on the other worlds of the
+	// process, the shadow reference and the arena, and its replay is not throttled alike.
+	if(throttles(opt) && (opt.shadow > 0.0 || opt.evaluate > 0 || !opt.log.empty())) {
+		fprintf(stderr, "memory budgets are shared by all worlds of the process, world budgets take no -V, -E or -l\n");
+		return 1;
+	}
+	if(!opt.log.empty() && opt.optimizer != "selector") {
+		fprintf(stderr, "replay logs re-simulate the selector, keyframes do not hold the state of %s\n", opt.optimizer.c_str());
+		return 1;
+	}
+	
+	rand_seed(opt.seed);
+	MyWorld world(double(opt.tiles)*default_world_size, opt.workers);
+	if(opt.adaptive > 0.0) {
+		world.adaptive = true;
+		world.dt_max = opt.adaptive;
+	}
+	if(opt.theta >= 0.0) {
+		world.field.theta = opt.theta;
+	}
+	if(opt.skin >= 0.0) {
+		world.neighbors.skin = opt.skin;
+	}
+	world.sensors.eyes = opt.eyes;
+	auto setup = [&opt](MyWorld &w) {
+		if(opt.tiles > 1) {
+			scatter(w, opt.tiles, opt.clusters);
+		} else {
+			populate(w);
+		}
+	};
+	std::unique_ptr<Shadow> shadow;
+	if(opt.shadow > 0.0) {
+		shadow.reset(new Shadow(world, setup, opt.shadow));
+	} else {
+		setup(world);
+	}
+	std::unique_ptr<Optimizer> hopt, copt;
+	if(opt.optimizer == "es") {
+		Herbivore h(world.sensors);
+		Carnivore c(world.sensors);
+		hopt.reset(new EvolutionStrategy(h.mind, opt.sigma));
+		copt.reset(new EvolutionStrategy(c.mind, opt.sigma));
+		world.hopt = hopt.get();
+		world.copt = copt.get();
+	} else if(opt.optimizer != "selector") {
+		fprintf(stderr, "unknown optimizer '%s'\n", opt.optimizer.c_str());
+		return 1;
+	}
+	
+	Archive *archive = nullptr;
+	if(!opt.archive.empty()) {
+		archive = new Archive(opt.archive.c_str());
+		if(!archive->good()) {
+			fprintf(stderr, "cannot open archive '%s'\n", opt.archive.c_str());
+			return 1;
+		}
+		printf("seeded %d champions from %ld archived minds\n", seed(world, *archive), archive->size());
+	}
+	
+	ReplayLog *log = nullptr;
+	if(!opt.log.empty()) {
+		log = new ReplayLog(&world, opt.log.c_str(), opt.seed, opt.keyframe);
+		if(!log->good()) {
+			fprintf(stderr, "cannot write replay log '%s'\n", opt.log.c_str());
+			return 1;
+		}
+		world.listeners.push_back(log);
+	}
+	
+	FILE *dyn = nullptr;
+	if(!opt.dynamics.empty()) {
+		dyn = fopen(opt.dynamics.c_str(), "w");
+		if(dyn == nullptr) {
+			fprintf(stderr, "cannot write dynamics '%s'\n", opt.dynamics.c_str());
+			return 1;
+		}
+		fprintf(dyn, "# state %s, seed %u\n", real_name(), opt.seed);
+		fprintf(dyn, "step,plants,herbivores,carnivores,plant_energy,herbivore_energy,carnivore_energy\n");
+		dynamics(dyn, world);
+	}
+	
+	Recorder *recorder = nullptr;
+	if(!opt.record.empty()) {
+		recorder = new Recorder(world, opt.record.c_str(), opt.record_period, opt.record_fraction);
+		if(!recorder->good()) {
+			fprintf(stderr, "cannot write recording '%s'\n", opt.record.c_str());
+			return 1;
+		}
+		world.listeners.push_back(recorder);
+	}
+	
+	StreamPublisher *stream = nullptr;
+	if(!opt.stream.empty()) {
+		stream = new StreamPublisher(world, opt.stream.c_str());
+		if(!stream->good()) {
+			fprintf(stderr, "cannot create stream '%s'\n", opt.stream.c_str());
+			return 1;
+		}
+		world.listeners.push_back(stream);
+	}
+	
+	int status = 0;
+	for(long i = 0; i < opt.steps; ++i) {
+		if(shadow == nullptr) {
+			world.step();
+		} else if(!shadow->step()) {
+			fprintf(stderr, "shadow reference %s", shadow->report().c_str());
+			status = 1;
+			break;
+		}
+		if(world.step_index % opt.report == 0) {
+			report(world);
+			if(shadow != nullptr) {
+				printf("  shadow     reference agrees, %ld organism states compared\n", shadow->compared);
+			}
+			if(dyn != nullptr) {
+				dynamics(dyn, world);
+			}
+			// written at every report, so an interrupted run keeps its champions
+			if(archive != nullptr) {
+				store(world, *archive, opt.seed);
+				if(!archive->flush()) {
+					fprintf(stderr, "cannot write archive '%s'\n", opt.archive.c_str());
+					status = 1;
+					break;
+				}
+			}
+		}
+	}
+	
+	if(log != nullptr) {
+		world.listeners.remove(log);
+		bool ok = log->close();
+		delete log;
+		if(!ok) {
+			fprintf(stderr, "cannot write replay log '%s'\n", opt.log.c_str());
+			status = 1;
+		}
+	}
+	
+	if(dyn != nullptr) {
+		fclose(dyn);
+	}
+	
+	if(recorder != nullptr) {
+		world.listeners.remove(recorder);
+		bool ok = recorder->close();
+		long stalls = recorder->stalls(), dropped = recorder->dropped;
+		delete recorder;
+		printf("recording: %ld stalls, %ld steps dropped over budget\n", stalls, dropped);
+		if(!ok) {
+			fprintf(stderr, "cannot write recording '%s'\n", opt.record.c_str());
+			status = 1;
+		}
+	}
+	
+	if(stream != nullptr) {
+		world.listeners.remove(stream);
+		delete stream;
+	}
+	
+	if(!opt.trace.empty()) {
+		Trace::get().stop();
+		long dropped = Trace::get().dropped();
+		if(!Trace::get().save(opt.trace.c_str())) {
+			fprintf(stderr, "cannot write trace '%s'\n", opt.trace.c_str());
+			return 1;
+		}
+		printf("trace: %ld spans dropped\n", dropped);
+	}
+	
+	if(opt.evaluate > 0) {
+		std::vector<Arena::Candidate> cands;
+		for(Kind k : {KIND_HERBIVORE, KIND_CARNIVORE}) {
+			const Selector &sel = k == KIND_HERBIVORE ? world.hsel : world.csel;
+			const Optimizer *o = k == KIND_HERBIVORE ? world.hopt : world.copt;
+			if(o != &sel) {
+				// the current estimate of another optimizer
+				if(o->best() != nullptr) {
+					cands.push_back(Arena::Candidate{k, o->best()});
+				}
+				continue;
+			}
+			int n = 0;
+			for(auto it = sel.champions.rbegin(); it != sel.champions.rend() && n < opt.evaluate; ++it, ++n) {
+				cands.push_back(Arena::Candidate{k, &it->mind});
+			}
+		}
+		evaluate(opt, cands);
+	}
+	
+	if(archive != nullptr) {
+		store(world, *archive, opt.seed);
+		bool ok = archive->flush();
+		delete archive;
+		if(!ok) {
+			fprintf(stderr, "cannot write archive '%s'\n", opt.archive.c_str());
+			return 1;
+		}
+	}
+	
+	if(!opt.lineage.empty() && !world.lineage.save(opt.lineage.c_str())) {
+		fprintf(stderr, "cannot write lineage '%s'\n", opt.lineage.c_str());
+		return 1;
+	}
+	
+	return status;
+}
@@ -1,28 +1,31 @@
+#include <cstdio>
+#include <cstdlib>
+
 #include <QApplication>
 
 #include <la/vec.hpp>
 
 #include <event.hpp>
+#include <trace.hpp>
 
 #include <graphics/window.hpp>
 #include <world/myworld.hpp>
+#include <world/setup.hpp>
 
 #include "world/random.hpp"
 
 
 int main(int argc, char *argv[]) {
-	MyWorld world(vec2(1000, 1600));
-	
-	SpawnAnimal *s;
-	world.add(s = new SpawnHerbivore(vec2(0, 1500), 100, 10, 0));
-	s->mindgen = [&world](){return world.hsel.genMind();};
-	world.add(new SpawnPlant(vec2(0, 1300), 300, 0, 100));
-	
-	world.add(new SpawnPlant(vec2(0, 0), 1000, 0, 200));
+	// NEVO_TRACE=<file> saves a timeline of the simulation and GUI threads at exit
+	const char *trace = getenv("NEVO_TRACE");
+	if(trace != nullptr) {
+		Trace::get().name("gui");
+		Trace::get().start();
+	}
 	
-	world.add(s = new SpawnCarnivore(vec2(0, -1500), 100, 10, 0));
-	s->mindgen = [&world](){return world.csel.genMind();};
-	world.add(new SpawnPlant(vec2(0, -1300), 300, 0, 100));
+	MyWorld world(default_world_size);
+	populate(world);
+	world.governor.rate = 100.0;
 	
 	QApplication app(argc, argv);
 	
@@ -30,15 +33,25 @@ int main(int argc, char *argv[]) {
 	window.show();
 	
 	
-	world.sync = [&app, &window]() {
-		app.postEvent(&window, new SyncEvent());
+	// the window pulls frames on its own timer, a step only marks it out of date; the
+	// governor sets the delay of World, which the loop of World sleeps after the callback
+	world.sync = [&world, &window]() {
+		window.post();
+		world.setDelay(int(1e6*world.governor.delay()));
 	};
-	std::thread thread([&world](){world();});
-
+	std::thread thread([&world](){
+		Trace::get().name("simulation");
+		world();
+	});
+	
 	int rs = app.exec();
-
+	
 	world.done = true;
 	thread.join();
-
+	
+	if(trace != nullptr && !Trace::get().save(trace)) {
+		fprintf(stderr, "cannot write trace '%s'\n", trace);
+	}
+	
 	return rs;
 }
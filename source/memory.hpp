@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+
+enum MemoryTag {
+	MEM_ORGANISMS = 0,
+	MEM_MINDS,
+	MEM_SELECTOR,
+	MEM_SCENE,
+	MEM_RECORDERS,
+	MEM_CHARTS,
+	MEM_STREAM,
+	MEM_TAG_COUNT
+};
+
+// Bytes held by each subsystem of the process, charged where the memory is owned. Counts
+// are estimates from object and buffer sizes, not allocator statistics. A subsystem over
+// its budget applies back-pressure where it grows: worlds stop producing organisms,
+// selectors admit no champions, the scene syncs less often, recorders drop steps. The counts are shared by every world of the process, so a budget
+// on a world's tags makes its run depend on the other worlds alive at the same time.
+class Memory {
+private:
+	std::atomic<int64_t> used[MEM_TAG_COUNT], limit[MEM_TAG_COUNT];
+	
+	Memory() {
+		for(int i = 0; i < MEM_TAG_COUNT; ++i) {
+			used[i] = 0;
+			limit[i] = 0;
+		}
+	}
+
+public:
+	static Memory &get() {
+		static Memory memory;
+		return memory;
+	}
+	
+	static const char *name(int tag) {
+		static const char *names[MEM_TAG_COUNT] = {"organisms", "minds", "selector", "scene", "recorders", "charts", "stream"};
+		return names[tag];
+	}
+	
+	// tag of `name`, -1 if there is none
+	static int find(const char *name) {
+		for(int i = 0; i < MEM_TAG_COUNT; ++i) {
+			if(strcmp(name, Memory::name(i)) == 0) {
+				return i;
+			}
+		}
+		return -1;
+	}
+	
+	void charge(MemoryTag tag, int64_t bytes) {
+		used[tag].fetch_add(bytes, std::memory_order_relaxed);
+	}
+	
+	int64_t bytes(int tag) const {
+		return used[tag].load(std::memory_order_relaxed);
+	}
+	int64_t total() const {
+		int64_t t = 0;
+		for(int i = 0; i < MEM_TAG_COUNT; ++i) {
+			t += bytes(i);
+		}
+		return t;
+	}
+	
+	// hard budget of a subsystem in bytes, 0 for none
+	void budget(int tag, int64_t bytes) {
+		limit[tag] = bytes;
+	}
+	int64_t budget(int tag) const {
+		return limit[tag].load(std::memory_order_relaxed);
+	}
+	
+	bool over(int tag) const {
+		int64_t b = budget(tag);
+		return b > 0 && bytes(tag) >= b;
+	}
+	
+	void print(FILE *f) const {
+		fprintf(f, "  memory     total %.2f MB:", bytes_mb(total()));
+		for(int i = 0; i < MEM_TAG_COUNT; ++i) {
+			fprintf(f, "%s %s %.3f", i > 0 ? "," : "", name(i), bytes_mb(bytes(i)));
+			if(budget(i) > 0) {
+				fprintf(f, "/%.3f%s", bytes_mb(budget(i)), over(i) ? " (over)" : "");
+			}
+		}
+		fprintf(f, "\n");
+	}
+	
+	static double bytes_mb(int64_t b) {
+		return double(b)/(1 << 20);
+	}
+};
+
+// Bytes charged to a subsystem for the lifetime of the owner; copies charge again
+class MemoryCharge {
+private:
+	MemoryTag tag;
+	int64_t bytes = 0;
+
+public:
+	MemoryCharge(MemoryTag t, int64_t b = 0) : tag(t) {
+		set(b);
+	}
+	MemoryCharge(const MemoryCharge &c) : tag(c.tag) {
+		set(c.bytes);
+	}
+	MemoryCharge &operator=(const MemoryCharge &c) {
+		set(c.bytes);
+		return *this;
+	}
+	~MemoryCharge() {
+		set(0);
+	}
+	
+	void set(int64_t b) {
+		if(b != bytes) {
+			Memory::get().charge(tag, b - bytes);
+			bytes = b;
+		}
+	}
+};
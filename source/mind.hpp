@@ -1,26 +1,144 @@
 #pragma once
 
+#include <cmath>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <vector>
 
+#include "memory.hpp"
+
+// Standard normal numbers by Box-Muller over a minstd_rand stream. Unlike
+// std::normal_distribution the sequence is the same with every standard library,
+// so a seed alone reproduces a mutation on any toolchain.
+class NormalStream {
+private:
+	std::minstd_rand engine;
+	double spare = 0.0;
+	bool has_spare = false;
+	
+	// in (0, 1), the engine never yields 0 or its modulus
+	double uniform() {
+		return double(engine())/double(std::minstd_rand::modulus);
+	}
+
+public:
+	NormalStream(unsigned seed) : engine(seed) {}
+	
+	float operator()() {
+		if(has_spare) {
+			has_spare = false;
+			return float(spare);
+		}
+		double r = sqrt(-2.0*log(uniform())), a = 2.0*M_PI*uniform();
+		spare = r*sin(a);
+		has_spare = true;
+		return float(r*cos(a));
+	}
+};
+
+// Block of weights shared by reference between minds (parent and offspring,
+// champions and the spawned copies). A block owning its weights is never
+// written after construction; a mind that diverges gets a fresh block.
+// A block derived by a seeded mutation stores only its parent and the mutation
+// until its weights are first read, so offspring that never think cost no weights.
+// A block may instead view weights owned elsewhere, such as the rows of the
+// embedding API. Those are not immutable: their owner rewrites them between
+// steps, and every mind holding the block runs on the new weights from then on.
+class Genome {
+public:
+	// made on first use for a derived block, minds on several threads may ask at once
+	mutable std::vector<float> weight;
+	const float *external = nullptr;
+	int external_size = 0;
+	
+	// mutation that produced this block from its parent block
+	unsigned seed = 0;
+	float delta = 0.0f;
+
+private:
+	// parent of a derived block, released once the weights are made
+	mutable std::shared_ptr<const Genome> parent;
+	bool derived = false;
+	int derived_size = 0;
+	mutable std::once_flag made;
+	
+	mutable MemoryCharge memory = MemoryCharge(MEM_MINDS);
+	
+	void make() const {
+		std::call_once(made, [this]() {
+			const float *src = parent->data();
+			NormalStream normal(seed);
+			weight.resize(derived_size);
+			for(int i = 0; i < derived_size; ++i) {
+				weight[i] = src[i] + normal()*delta;
+			}
+			parent.reset();
+			account();
+		});
+	}
+
+public:
+	Genome(int nw) {
+		weight.resize(nw, 0.0f);
+		account();
+	}
+	
+	// external weights are charged by their owner
+	Genome(const float *ext, int nw) : external(ext), external_size(nw) {
+		account();
+	}
+	
+	// derived from `p` by the seeded mutation (seed, delta)
+	Genome(const std::shared_ptr<const Genome> &p, unsigned s, float d) :
+		seed(s), delta(d), parent(p), derived(true), derived_size(p->size())
+	{
+		account();
+	}
+	
+	// charges the weights again after they were replaced
+	void account() const {
+		memory.set(sizeof(Genome) + sizeof(float)*weight.capacity());
+	}
+	
+	const float *data() const {
+		if(external != nullptr) {
+			return external;
+		}
+		if(derived) {
+			make();
+		}
+		return weight.data();
+	}
+	int size() const {
+		return external != nullptr ? external_size : derived ? derived_size : int(weight.size());
+	}
+};
+
 class Mind {
 public:
 	std::vector<float> input;
 	std::vector<float> output;
-	std::vector<float> weight;
 	std::vector<float> memory;
+	
+	std::shared_ptr<const Genome> genome;
+	
+	// uid of the organism this mind was inherited from
+	long origin = -1;
 
 	Mind(int ni, int no, int nw, int nm) {
 		input.resize(ni, 0.0f);
 		output.resize(no, 0.0f);
-		weight.resize(nw, 0.0f);
 		memory.resize(nm, 0.0f);
+		genome = std::make_shared<const Genome>(nw);
 	}
 	
 	void copy(const Mind &esrc) {
 		input = esrc.input;
 		output = esrc.output;
-		weight = esrc.weight;
+		genome = esrc.genome;
+		origin = esrc.origin;
 		memory.resize(esrc.memory.size(), 0.0f);
 	}
 	
@@ -33,15 +151,29 @@ public:
 		return *this;
 	}
 	
+	const float *weight() const {
+		return genome->data();
+	}
+	int weight_size() const {
+		return genome->size();
+	}
+	
+	// bytes of the state of the mind, without the shared weights
+	size_t footprint() const {
+		return sizeof(float)*(input.capacity() + output.capacity() + memory.capacity());
+	}
+	
 	void randomize(std::function<float()> rand) {
-		for(int i = 0; i < int(weight.size()); ++i) {
-			weight[i] = rand();
+		std::shared_ptr<Genome> g = std::make_shared<Genome>(weight_size());
+		for(int i = 0; i < int(g->weight.size()); ++i) {
+			g->weight[i] = rand();
 		}
+		genome = g;
 	}
 	
-	void vary(std::function<float()> rand, float delta) {
-		for(int i = 0; i < int(weight.size()); ++i) {
-			weight[i] += rand()*delta;
-		}
+	// copy-on-mutate: the child block holds the parent and (seed, delta), parent weights and
+	// noise are combined in a single pass when the child first reads them
+	void vary(unsigned seed, float delta) {
+		genome = std::make_shared<const Genome>(genome, seed, delta);
 	}
 };
@@ -0,0 +1,276 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+#include <world/myworld.hpp>
+#include <world/setup.hpp>
+
+#include "nevo.h"
+
+// Minds of one species in a contiguous buffer: spawns take the rows in turn, and
+// animals remember the row they descend from to credit their score when they die.
+struct Pool {
+	Kind kind;
+	int nw = 0;
+	std::vector<float> weights;
+	MemoryCharge memory = MemoryCharge(MEM_MINDS);
+	std::vector<Mind> minds;
+	std::vector<double> fitness;
+	std::vector<int64_t> samples;
+	
+	int next = 0;
+	// rows handed to spawns whose animals are not born yet
+	std::deque<int> spawned;
+	
+	Pool(Kind k, const Mind &proto, int slots) : kind(k) {
+		nw = proto.weight_size();
+		weights.resize(size_t(slots)*nw);
+		memory.set(sizeof(float)*weights.size());
+		for(float &w : weights) {
+			w = float(rand_norm());
+		}
+		for(int i = 0; i < slots; ++i) {
+			minds.push_back(proto);
+			minds.back().genome = std::make_shared<const Genome>(weights.data() + size_t(i)*nw, nw);
+			minds.back().origin = -1;
+		}
+		fitness.resize(slots, 0.0);
+		samples.resize(slots, 0);
+	}
+	
+	const Mind *take() {
+		int i = next;
+		next = (next + 1) % int(minds.size());
+		spawned.push_back(i);
+		return &minds[i];
+	}
+};
+
+struct nevo_world : public Listener {
+	MyWorld *world = nullptr;
+	std::string rng;
+	nevo_shape shape;
+	
+	Pool *pools[KIND_COUNT] = {nullptr};
+	std::unordered_map<long, int> slot;
+	
+	// copy of the population, made on request once the world has stepped
+	nevo_state state;
+	bool gathered = false;
+	std::vector<int64_t> uid;
+	std::vector<int32_t> kind, slots;
+	std::vector<double> x, y, dir_x, dir_y, energy, score;
+	std::vector<float> inputs, outputs;
+	
+	~nevo_world() {
+		if(world != nullptr) {
+			world->listeners.remove(this);
+			delete world;
+		}
+		for(Pool *p : pools) {
+			delete p;
+		}
+	}
+	
+	void born(Organism *e, Organism *parent) override {
+		Pool *p = pools[e->kind()];
+		if(p == nullptr) {
+			return;
+		}
+		int s = -1;
+		if(dynamic_cast<Spawn*>(parent) != nullptr) {
+			if(!p->spawned.empty()) {
+				s = p->spawned.front();
+				p->spawned.pop_front();
+			}
+		} else {
+			auto it = slot.find(parent->uid);
+			s = it != slot.end() ? it->second : -1;
+		}
+		slot[e->uid] = s;
+	}
+	
+	void died(Organism *e) override {
+		auto it = slot.find(e->uid);
+		if(it == slot.end()) {
+			return;
+		}
+		Pool *p = pools[e->kind()];
+		if(it->second >= 0) {
+			p->fitness[it->second] += e->score();
+			p->samples[it->second] += 1;
+		}
+		slot.erase(it);
+	}
+	
+	void gather() {
+		size_t n = world->animals.size();
+		int ni = shape.inputs, no = shape.outputs;
+		uid.resize(n);
+		kind.resize(n);
+		slots.resize(n);
+		x.resize(n);
+		y.resize(n);
+		dir_x.resize(n);
+		dir_y.resize(n);
+		energy.resize(n);
+		score.resize(n);
+		inputs.resize(n*ni);
+		outputs.resize(n*no);
+		size_t i = 0;
+		for(auto &p : world->animals) {
+			const Animal *a = p.second;
+			uid[i] = a->uid;
+			kind[i] = a->kind();
+			auto it = slot.find(a->uid);
+			slots[i] = it != slot.end() ? it->second : -1;
+			x[i] = a->pos.x();
+			y[i] = a->pos.y();
+			dir_x[i] = a->dir.x();
+			dir_y[i] = a->dir.y();
+			energy[i] = a->energy;
+			score[i] = a->score();
+			std::copy(a->mind.input.begin(), a->mind.input.begin() + ni, inputs.begin() + i*ni);
+			std::copy(a->mind.output.begin(), a->mind.output.begin() + no, outputs.begin() + i*no);
+			++i;
+		}
+		state.step = world->step_index;
+		state.count = int64_t(n);
+		state.uid = uid.data();
+		state.kind = kind.data();
+		state.slot = slots.data();
+		state.x = x.data();
+		state.y = y.data();
+		state.dir_x = dir_x.data();
+		state.dir_y = dir_y.data();
+		state.energy = energy.data();
+		state.score = score.data();
+		state.inputs = inputs.data();
+		state.outputs = outputs.data();
+		gathered = true;
+	}
+};
+
+// swaps the generator state of a world with that of the calling thread
+class RandScope {
+private:
+	std::string &state;
+	std::string saved;
+
+public:
+	RandScope(std::string &s) : state(s), saved(rand_state()) {
+		rand_restore(state);
+	}
+	~RandScope() {
+		state = rand_state();
+		rand_restore(saved);
+	}
+};
+
+extern "C" {
+
+int nevo_version(void) {
+	return NEVO_API_VERSION;
+}
+
+void nevo_config_default(nevo_config *c) {
+	c->seed = 0;
+	c->tiles = 1;
+	c->clusters = 1;
+	c->eyes = 0;
+	c->adaptive = 0.0;
+	c->slots = 0;
+}
+
+nevo_world *nevo_create(const nevo_config *c) {
+	if(c == nullptr || c->tiles < 1 || c->clusters < 1 || c->eyes < 0 || c->slots < 0) {
+		return nullptr;
+	}
+	nevo_world *w = new nevo_world();
+	std::string saved = rand_state();
+	rand_seed(c->seed);
+	
+	w->world = new MyWorld(double(c->tiles)*default_world_size);
+	w->world->sensors.eyes = c->eyes;
+	if(c->tiles > 1) {
+		scatter(*w->world, c->tiles, c->clusters);
+	} else {
+		populate(*w->world);
+	}
+	if(c->adaptive > 0.0) {
+		w->world->adaptive = true;
+		w->world->dt_max = c->adaptive;
+	}
+	
+	Herbivore h(w->world->sensors);
+	Carnivore cv(w->world->sensors);
+	w->shape.inputs = int(h.mind.input.size());
+	w->shape.outputs = int(h.mind.output.size());
+	w->shape.hidden = int(h.mind.memory.size());
+	w->shape.weights = h.mind.weight_size();
+	if(c->slots > 0) {
+		w->pools[KIND_HERBIVORE] = new Pool(KIND_HERBIVORE, h.mind, c->slots);
+		w->pools[KIND_CARNIVORE] = new Pool(KIND_CARNIVORE, cv.mind, c->slots);
+		for(auto &p : w->world->entities) {
+			SpawnAnimal *s = dynamic_cast<SpawnAnimal*>(p.second);
+			if(s != nullptr) {
+				Pool *pool = w->pools[s->kind() == KIND_SPAWN_HERBIVORE ? KIND_HERBIVORE : KIND_CARNIVORE];
+				s->mindgen = [pool](){return SpawnMind{pool->take(), true};};
+			}
+		}
+		w->world->listeners.push_back(w);
+	}
+	
+	w->rng = rand_state();
+	rand_restore(saved);
+	return w;
+}
+
+void nevo_destroy(nevo_world *w) {
+	if(w != nullptr) {
+		delete w;
+	}
+}
+
+int64_t nevo_step(nevo_world *w, int64_t steps) {
+	RandScope scope(w->rng);
+	for(int64_t i = 0; i < steps; ++i) {
+		w->world->step();
+	}
+	w->gathered = false;
+	return w->world->step_index;
+}
+
+nevo_shape nevo_mind_shape(const nevo_world *w) {
+	return w->shape;
+}
+
+const nevo_state *nevo_population(nevo_world *w) {
+	if(!w->gathered) {
+		w->gather();
+	}
+	return &w->state;
+}
+
+static Pool *pool(nevo_world *w, int kind) {
+	return kind == KIND_HERBIVORE || kind == KIND_CARNIVORE ? w->pools[kind] : nullptr;
+}
+
+float *nevo_weights(nevo_world *w, int kind) {
+	Pool *p = pool(w, kind);
+	return p != nullptr ? p->weights.data() : nullptr;
+}
+
+double *nevo_fitness(nevo_world *w, int kind) {
+	Pool *p = pool(w, kind);
+	return p != nullptr ? p->fitness.data() : nullptr;
+}
+
+int64_t *nevo_samples(nevo_world *w, int kind) {
+	Pool *p = pool(w, kind);
+	return p != nullptr ? p->samples.data() : nullptr;
+}
+
+}
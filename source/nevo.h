@@ -0,0 +1,93 @@
+#ifndef NEVO_H
+#define NEVO_H
+
+/* C interface of the simulation, built as libnevo, for driving worlds from external
+ * trainers. Population state and minds are exposed as contiguous buffers owned by the
+ * world, so a whole generation is read and written without per-organism calls. The
+ * weights are shared with the minds in place; the population state is a copy.
+ *
+ * Each world keeps its own random generator state, so worlds with equal configs
+ * evolve identically whatever else runs in the process. Calls on one world must not
+ * overlap; distinct worlds may be stepped from distinct threads, each with its own
+ * eye count. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NEVO_API_VERSION 1
+
+#define NEVO_API __attribute__((visibility("default")))
+
+enum nevo_kind {
+	NEVO_HERBIVORE = 2,
+	NEVO_CARNIVORE = 3
+};
+
+typedef struct nevo_config {
+	unsigned seed;
+	/* map of tiles x tiles default-sized worlds, `clusters` of them populated */
+	int tiles, clusters;
+	/* eye rays per animal */
+	int eyes;
+	/* adaptive timestep up to this step length, 0 for fixed steps */
+	double adaptive;
+	/* minds per species in the weight buffers; spawns then take their minds from the
+	 * buffer rows in turn. 0 keeps the champion selector. */
+	int slots;
+} nevo_config;
+
+/* Layout of one mind: weights hold W_ih (hidden x inputs), W_hh (hidden x hidden),
+ * b_h (hidden), W_ho (outputs x hidden) and b_o (outputs), in that order. */
+typedef struct nevo_shape {
+	int inputs, outputs, hidden, weights;
+} nevo_shape;
+
+/* Living animals in uid order, valid until the next call on the world. `inputs` and
+ * `outputs` hold `count` rows of the mind shape. The simulation keeps its state per
+ * organism, so the columns are a copy, made by the first nevo_population() after a
+ * step at a cost linear in `count` times the mind inputs and outputs. */
+typedef struct nevo_state {
+	int64_t step;
+	int64_t count;
+	const int64_t *uid;
+	const int32_t *kind;
+	/* weight row the animal descends from, -1 without slots */
+	const int32_t *slot;
+	const double *x, *y;
+	const double *dir_x, *dir_y;
+	const double *energy, *score;
+	const float *inputs, *outputs;
+} nevo_state;
+
+typedef struct nevo_world nevo_world;
+
+NEVO_API int nevo_version(void);
+
+NEVO_API void nevo_config_default(nevo_config *config);
+
+/* NULL if the config is invalid */
+NEVO_API nevo_world *nevo_create(const nevo_config *config);
+NEVO_API void nevo_destroy(nevo_world *world);
+
+/* runs `steps` steps, returns the step index */
+NEVO_API int64_t nevo_step(nevo_world *world, int64_t steps);
+
+NEVO_API nevo_shape nevo_mind_shape(const nevo_world *world);
+NEVO_API const nevo_state *nevo_population(nevo_world *world);
+
+/* Per species buffers of `slots` rows, NULL without slots. Weights are read in place
+ * by newly spawned animals and may be written between steps. Fitness and samples
+ * accumulate the score and the number of the dead animals descended from each row
+ * and are reset by the caller. */
+NEVO_API float *nevo_weights(nevo_world *world, int kind);
+NEVO_API double *nevo_fitness(nevo_world *world, int kind);
+NEVO_API int64_t *nevo_samples(nevo_world *world, int kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// Opt-in timeline of named spans on all threads of the process, saved as Chrome trace
+// JSON for chrome://tracing or ui.perfetto.dev. Each thread records into a buffer of its
+// own with a single writer, so recording takes no lock; spans beyond the capacity of a
+// buffer are dropped and counted. While tracing is off a span costs one relaxed load.
+class Trace {
+public:
+	struct Span {
+		// string literal, stored by pointer
+		const char *name;
+		// ns of the steady clock
+		int64_t begin, end;
+	};
+	
+	struct Buffer {
+		const char *thread;
+		int tid;
+		std::vector<Span> spans;
+		std::atomic<size_t> count;
+		std::atomic<long> dropped;
+		
+		Buffer(const char *t, int id, size_t capacity) : thread(t), tid(id), spans(capacity), count(0), dropped(0) {}
+		
+		void push(const char *name, int64_t b, int64_t e) {
+			size_t n = count.load(std::memory_order_relaxed);
+			if(n == spans.size()) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			spans[n] = Span{name, b, e};
+			count.store(n + 1, std::memory_order_release);
+		}
+	};
+
+private:
+	std::atomic<bool> on;
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Buffer>> buffers;
+	size_t capacity = 0;
+	int64_t origin = 0;
+	
+	Trace() : on(false) {}
+	
+	static const char *&thread_name() {
+		static thread_local const char *name = nullptr;
+		return name;
+	}
+	
+	// buffer of the calling thread, registered on its first span
+	Buffer *local() {
+		static thread_local Buffer *buffer = nullptr;
+		if(buffer == nullptr) {
+			std::lock_guard<std::mutex> lock(mutex);
+			buffers.emplace_back(new Buffer(thread_name(), int(buffers.size()) + 1, capacity));
+			buffer = buffers.back().get();
+		}
+		return buffer;
+	}
+
+public:
+	static Trace &get() {
+		static Trace trace;
+		return trace;
+	}
+	
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	
+	bool enabled() const {
+		return on.load(std::memory_order_relaxed);
+	}
+	
+	// `spans` per thread, allocated by each thread when it records its first span
+	void start(size_t spans = size_t(1) << 20) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if(capacity == 0) {
+			capacity = spans;
+			origin = now();
+		}
+		on = true;
+	}
+	
+	void stop() {
+		on = false;
+	}
+	
+	// label of the calling thread in the trace, a string literal
+	void name(const char *n) {
+		thread_name() = n;
+	}
+	
+	void record(const char *name, int64_t begin, int64_t end) {
+		if(enabled()) {
+			local()->push(name, begin, end);
+		}
+	}
+	
+	long dropped() {
+		std::lock_guard<std::mutex> lock(mutex);
+		long n = 0;
+		for(auto &b : buffers) {
+			n += b->dropped;
+		}
+		return n;
+	}
+	
+	// writes the spans recorded so far, also while other threads keep recording
+	bool save(const char *path) {
+		FILE *f = fopen(path, "w");
+		if(f == nullptr) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		bool first = true;
+		for(auto &b : buffers) {
+			fprintf(f, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+				first ? "" : ",\n", b->tid, b->thread != nullptr ? b->thread : "thread"
+			);
+			first = false;
+			size_t n = b->count.load(std::memory_order_acquire);
+			for(size_t i = 0; i < n; ++i) {
+				const Span &s = b->spans[i];
+				fprintf(f, ",\n{\"ph\": \"X\", \"name\": \"%s\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+					s.name, b->tid, 1e-3*(s.begin - origin), 1e-3*(s.end - s.begin)
+				);
+			}
+		}
+		long lost = 0;
+		for(auto &b : buffers) {
+			lost += b->dropped;
+		}
+		fprintf(f, "\n], \"otherData\": {\"dropped\": %ld}}\n", lost);
+		return fclose(f) == 0;
+	}
+};
+
+// Records the span of its scope
+class TraceSpan {
+private:
+	const char *name;
+	int64_t begin;
+
+public:
+	TraceSpan(const char *n) : name(n), begin(Trace::get().enabled() ? Trace::now() : -1) {}
+	~TraceSpan() {
+		if(begin >= 0) {
+			Trace::get().record(name, begin, Trace::now());
+		}
+	}
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Variable length integers: 7 bits per byte, low bits first, the high bit set on all bytes
+// but the last. Signed values are zigzag mapped first, so small magnitudes stay short.
+struct Varint {
+	static void put(std::vector<char> &out, uint64_t v) {
+		while(v >= 0x80) {
+			out.push_back(char(0x80 | (v & 0x7f)));
+			v >>= 7;
+		}
+		out.push_back(char(v));
+	}
+	
+	// false if the input ends inside the value or the value is longer than 64 bits
+	static bool get(const char *&p, const char *end, uint64_t &v) {
+		v = 0;
+		for(int s = 0; p < end && s < 64; s += 7) {
+			uint8_t c = uint8_t(*p++);
+			v |= uint64_t(c & 0x7f) << s;
+			if(!(c & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	static uint64_t zigzag(int64_t v) {
+		return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+	}
+	static int64_t unzigzag(uint64_t v) {
+		return int64_t(v >> 1) ^ -int64_t(v & 1);
+	}
+};
@@ -65,8 +65,8 @@ void copy(slice<T> &o, const slice<T> &a) {
 	}
 }
 
-template <typename T>
-void add(slice<T> &o, const slice<T> &a, const slice<T> &b) {
+template <typename T, typename A, typename B>
+void add(slice<T> &o, const slice<A> &a, const slice<B> &b) {
 	_vassert(o.size() == a.size());
 	_vassert(o.size() == b.size());
 	for(int i = 0; i < o.size(); ++i) {
@@ -74,8 +74,8 @@ void add(slice<T> &o, const slice<T> &a, const slice<T> &b) {
 	}
 }
 
-template <typename T>
-void dot(slice<T> &o, const slice<T> &m, const slice<T> &a) {
+template <typename T, typename M>
+void dot(slice<T> &o, const slice<M> &m, const slice<T> &a) {
 	_vassert(o.size()*a.size() == m.size());
 	int w = a.size();
 	for(int i = 0; i < o.size(); ++i) {
@@ -0,0 +1,233 @@
+#include <QApplication>
+#include <QWidget>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLabel>
+#include <QTimer>
+#include <QScreen>
+#include <QGuiApplication>
+
+#include <cstdio>
+#include <string>
+#include <map>
+#include <thread>
+#include <chrono>
+
+#include <la/vec.hpp>
+
+#include <graphics/myscene.hpp>
+#include <world/stream.hpp>
+
+
+// Mirror of a world published by another process. Organisms are rebuilt from the stream
+// frames and drawn by the same scene and items as in the simulator; the viewer can be
+// closed and started again at any time without affecting the simulation.
+class Viewer : public QWidget {
+public:
+	StreamReader *reader;
+	vec2 ws;
+	// entities are owned by the mirror world, `bodies` maps uids to them and their keys
+	World mirror;
+	std::map<long, std::pair<long, Organism*>> bodies;
+	StreamFrame frame;
+	
+	MyScene scene;
+	View view;
+	
+	QLabel status;
+	QLabel stats;
+	QVBoxLayout side;
+	QHBoxLayout layout;
+	
+	QTimer frame_timer;
+	int ticks = 0;
+	
+	Viewer(StreamReader *r) : QWidget(), reader(r), ws(r->world_size()), mirror(ws), scene(&mirror) {
+		view.setScene(&scene);
+		
+		side.addWidget(&status);
+		side.addWidget(&stats);
+		side.addStretch(1);
+		
+		layout.addWidget(&view, 3);
+		layout.addLayout(&side, 1);
+		setLayout(&layout);
+		
+		resize(1280, 720);
+		setWindowTitle("Evolution viewer");
+		
+		fit();
+		
+		double hz = 60.0;
+		if(QScreen *screen = QGuiApplication::primaryScreen()) {
+			if(screen->refreshRate() > 1.0) {
+				hz = screen->refreshRate();
+			}
+		}
+		frame_timer.setTimerType(Qt::PreciseTimer);
+		connect(&frame_timer, &QTimer::timeout, [this] () {
+			poll();
+		});
+		frame_timer.start(int(1e3/hz));
+	}
+	
+	// zooms the view to the world
+	void fit() {
+		vec2 zv = vec2(view.size().width(), view.size().height())/(2*ws);
+		float z = zv.x() > zv.y() ? zv.x() : zv.y();
+		view.resetTransform();
+		view.scale(z, z);
+	}
+	
+	// the new simulation may have another world size, positions are decoded relative to it
+	void reattached() {
+		while(!bodies.empty()) {
+			remove(bodies.begin());
+		}
+		vec2 s = reader->world_size();
+		if(s.x() != ws.x() || s.y() != ws.y()) {
+			ws = s;
+			mirror.size = s;
+			fit();
+		}
+		scene.sync();
+	}
+	
+	static Organism *instance(int kind) {
+		switch(kind) {
+		case KIND_PLANT:
+			return new Plant();
+		case KIND_HERBIVORE:
+			return new Herbivore(Sensors());
+		case KIND_CARNIVORE:
+			return new Carnivore(Sensors());
+		case KIND_SPAWN_PLANT:
+			return new SpawnPlant(nullvec2, 0.0, 0.0, 0);
+		case KIND_SPAWN_HERBIVORE:
+			return new SpawnHerbivore(nullvec2, 0.0, 0.0, 0);
+		case KIND_SPAWN_CARNIVORE:
+			return new SpawnCarnivore(nullvec2, 0.0, 0.0, 0);
+		default:
+			return nullptr;
+		}
+	}
+	
+	void remove(std::map<long, std::pair<long, Organism*>>::iterator it) {
+		mirror.entities.erase(it->second.first);
+		delete it->second.second;
+		bodies.erase(it);
+	}
+	
+	void update(const StreamBody &b) {
+		auto it = bodies.find(b.uid);
+		if(it != bodies.end() && it->second.second->kind() != b.kind) {
+			remove(it);
+			it = bodies.end();
+		}
+		Organism *e = nullptr;
+		if(it == bodies.end()) {
+			e = instance(b.kind);
+			if(e == nullptr) {
+				return;
+			}
+			e->uid = b.uid;
+			// keyed as World::add does
+			long key = mirror.id_counter++;
+			mirror.entities.insert(std::make_pair(key, static_cast<Entity*>(e)));
+			bodies[b.uid] = std::make_pair(key, e);
+		} else {
+			e = it->second.second;
+		}
+		
+		e->pos = b.position(ws);
+		double r = b.radius();
+		if(auto s = dynamic_cast<Spawn*>(e)) {
+			s->rad = r;
+		} else {
+			e->energy = 4.0*r*r;
+		}
+		if(auto a = dynamic_cast<Animal*>(e)) {
+			a->dir = b.heading();
+		}
+	}
+	
+	void apply(const StreamFrame &f) {
+		if(f.type == STREAM_KEY) {
+			// bodies missing from a keyframe are gone
+			auto bi = f.bodies.begin();
+			for(auto it = bodies.begin(); it != bodies.end();) {
+				while(bi != f.bodies.end() && bi->uid < it->first) {
+					++bi;
+				}
+				if(bi == f.bodies.end() || bi->uid != it->first) {
+					remove(it++);
+				} else {
+					++it;
+				}
+			}
+		}
+		for(long uid : f.removed) {
+			auto it = bodies.find(uid);
+			if(it != bodies.end()) {
+				remove(it);
+			}
+		}
+		for(const StreamBody &b : f.bodies) {
+			update(b);
+		}
+	}
+	
+	void poll() {
+		ticks += 1;
+		if(!reader->attached() || reader->closed()) {
+			if(reader->attached()) {
+				reader->detach();
+				status.setText("Simulation has ended, waiting for a new one");
+			}
+			// retry a few times per second
+			if(ticks % 30 != 0 || !reader->attach()) {
+				return;
+			}
+			reattached();
+		}
+		
+		bool any = false;
+		while(reader->next(frame)) {
+			apply(frame);
+			any = true;
+		}
+		if(!any) {
+			return;
+		}
+		scene.sync();
+		
+		status.setText(("Step " + std::to_string(frame.step) + ", frames lost " + std::to_string(reader->lost)).c_str());
+		static const char *names[] = {"Plants", "Herbivores", "Carnivores"};
+		std::string text;
+		for(int i = 0; i < 3; ++i) {
+			const StreamSpecies &s = frame.species[i];
+			text += std::string(names[i]) + ": " + std::to_string(s.count) + ", energy " + std::to_string(int(s.energy)) +
+				", oldest " + std::to_string(s.oldest) + ", births/step " + std::to_string(s.birth_rate) + "\n";
+		}
+		stats.setText(text.c_str());
+	}
+};
+
+int main(int argc, char *argv[]) {
+	const char *name = argc > 1 ? argv[1] : "/nevo";
+	
+	StreamReader reader(name);
+	if(!reader.attach()) {
+		fprintf(stderr, "waiting for stream '%s'\n", name);
+		while(!reader.attach()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
+	}
+	
+	QApplication app(argc, argv);
+	
+	Viewer viewer(&reader);
+	viewer.show();
+	
+	return app.exec();
+}
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "organism.hpp"
+#include "selector.hpp"
+
+#define ARCHIVE_MAGIC "NEVOHOF1"
+#define ARCHIVE_INDEX_MAGIC "NEVOIDX1"
+
+struct ArchiveHeader {
+	char magic[8];
+	int64_t count;
+	// bytes of records following the header
+	int64_t size;
+};
+
+// run the record came from
+struct ArchiveMeta {
+	uint32_t seed = 0;
+	int64_t step = 0;
+	int64_t time = 0;
+};
+
+// followed by nw weights
+struct ArchiveRecord {
+	double score;
+	int32_t kind;
+	int32_t ni, no, nh, nw;
+	uint32_t seed;
+	int64_t uid, step, time;
+	
+	const float *weight() const {
+		return reinterpret_cast<const float*>(this + 1);
+	}
+	
+	static int64_t size(int nw) {
+		return (int64_t(sizeof(ArchiveRecord) + sizeof(float)*nw) + 7) & ~int64_t(7);
+	}
+};
+
+struct ArchiveEntry {
+	double score;
+	int32_t kind;
+	int32_t nw;
+	int64_t offset;
+};
+
+// by species, best first
+inline bool operator < (const ArchiveEntry &a, const ArchiveEntry &b) {
+	return a.kind != b.kind ? a.kind < b.kind : a.score > b.score;
+}
+
+// Hall of fame of champion minds, shared by all runs that use the same file.
+// Records are appended to the archive file, which is mapped read-only, so opening it
+// does not read the weights. The score index lives in a sidecar file `<path>.idx` and is
+// mapped as well; it is rebuilt from the record headers when it does not cover the archive
+// (e.g. after a crash between the two writes). Appends from concurrent runs are serialized
+// with a lock on the archive file.
+class Archive {
+private:
+	std::string path, index_path;
+	int fd = -1;
+	
+	const char *data = nullptr;
+	size_t data_size = 0;
+	const char *idx = nullptr;
+	size_t idx_size = 0;
+	
+	const ArchiveEntry *index = nullptr;
+	long index_count = 0;
+	std::vector<ArchiveEntry> rebuilt;
+	
+	std::vector<char> pending;
+	std::vector<ArchiveEntry> pending_index;
+	
+	// origins already appended by this process
+	std::set<long> stored;
+	
+	static const char *map(int f, size_t size) {
+		if(size == 0) {
+			return nullptr;
+		}
+		void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, f, 0);
+		return p == MAP_FAILED ? nullptr : static_cast<const char*>(p);
+	}
+	
+	void unmap() {
+		if(data != nullptr) {
+			munmap(const_cast<char*>(data), data_size);
+		}
+		if(idx != nullptr) {
+			munmap(const_cast<char*>(idx), idx_size);
+		}
+		data = idx = nullptr;
+		data_size = idx_size = 0;
+		index = nullptr;
+		index_count = 0;
+		rebuilt.clear();
+	}
+	
+	const ArchiveHeader *header() const {
+		return reinterpret_cast<const ArchiveHeader*>(data);
+	}
+	
+	bool write_index(const std::vector<ArchiveEntry> &list) const {
+		std::string tmp = index_path + ".tmp";
+		FILE *f = fopen(tmp.c_str(), "wb");
+		if(f == nullptr) {
+			return false;
+		}
+		int64_t n = list.size();
+		bool ok = fwrite(ARCHIVE_INDEX_MAGIC, 8, 1, f) == 1 && fwrite(&n, sizeof(n), 1, f) == 1;
+		if(ok && n > 0) {
+			ok = fwrite(list.data(), sizeof(ArchiveEntry), list.size(), f) == list.size();
+		}
+		ok = fclose(f) == 0 && ok;
+		return ok && rename(tmp.c_str(), index_path.c_str()) == 0;
+	}
+	
+	// maps the archive and its index, the archive lock must be held
+	bool load() {
+		unmap();
+		struct stat st;
+		if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ArchiveHeader)) {
+			return false;
+		}
+		data_size = st.st_size;
+		data = map(fd, data_size);
+		if(data == nullptr || memcmp(header()->magic, ARCHIVE_MAGIC, 8) != 0) {
+			return false;
+		}
+		
+		int f = open(index_path.c_str(), O_RDONLY);
+		if(f >= 0) {
+			if(fstat(f, &st) == 0) {
+				idx_size = st.st_size;
+				idx = map(f, idx_size);
+			}
+			close(f);
+		}
+		int64_t n = -1;
+		if(idx != nullptr && idx_size >= 16 && memcmp(idx, ARCHIVE_INDEX_MAGIC, 8) == 0) {
+			memcpy(&n, idx + 8, sizeof(n));
+		}
+		if(n == header()->count && idx_size == 16 + sizeof(ArchiveEntry)*n) {
+			index = reinterpret_cast<const ArchiveEntry*>(idx + 16);
+			index_count = n;
+			return true;
+		}
+		
+		int64_t end = sizeof(ArchiveHeader) + header()->size;
+		if(end > int64_t(data_size)) {
+			return false;
+		}
+		for(int64_t o = sizeof(ArchiveHeader); o + int64_t(sizeof(ArchiveRecord)) <= end;) {
+			const ArchiveRecord *r = reinterpret_cast<const ArchiveRecord*>(data + o);
+			if(r->nw < 0 || o + ArchiveRecord::size(r->nw) > end) {
+				break;
+			}
+			rebuilt.push_back(ArchiveEntry{r->score, r->kind, r->nw, o});
+			o += ArchiveRecord::size(r->nw);
+		}
+		std::sort(rebuilt.begin(), rebuilt.end());
+		write_index(rebuilt);
+		index = rebuilt.data();
+		index_count = rebuilt.size();
+		return true;
+	}
+
+public:
+	Archive(const char *p) : path(p), index_path(std::string(p) + ".idx") {
+		fd = open(p, O_RDWR | O_CREAT, 0644);
+		if(fd < 0) {
+			return;
+		}
+		flock(fd, LOCK_EX);
+		struct stat st;
+		if(fstat(fd, &st) == 0 && st.st_size == 0) {
+			ArchiveHeader h;
+			memcpy(h.magic, ARCHIVE_MAGIC, 8);
+			h.count = 0;
+			h.size = 0;
+			if(pwrite(fd, &h, sizeof(h), 0) != ssize_t(sizeof(h))) {
+				close(fd);
+				fd = -1;
+				return;
+			}
+		}
+		if(!load()) {
+			unmap();
+			flock(fd, LOCK_UN);
+			close(fd);
+			fd = -1;
+			return;
+		}
+		flock(fd, LOCK_UN);
+	}
+	
+	~Archive() {
+		flush();
+		unmap();
+		if(fd >= 0) {
+			close(fd);
+		}
+	}
+	
+	bool good() const {
+		return fd >= 0;
+	}
+	
+	long size() const {
+		return index_count;
+	}
+	
+	// entries of one species, best first
+	const ArchiveEntry *begin(Kind k) const {
+		ArchiveEntry e{0.0, int32_t(k), 0, 0};
+		return std::lower_bound(index, index + index_count, e, [](const ArchiveEntry &a, const ArchiveEntry &b) {
+			return a.kind < b.kind;
+		});
+	}
+	const ArchiveEntry *end(Kind k) const {
+		ArchiveEntry e{0.0, int32_t(k), 0, 0};
+		return std::upper_bound(index, index + index_count, e, [](const ArchiveEntry &a, const ArchiveEntry &b) {
+			return a.kind < b.kind;
+		});
+	}
+	
+	const ArchiveRecord &record(const ArchiveEntry &e) const {
+		return *reinterpret_cast<const ArchiveRecord*>(data + e.offset);
+	}
+	
+	// copies the weights of one record into a mind of the same shape
+	bool get(const ArchiveEntry &e, Mind &m) const {
+		const ArchiveRecord &r = record(e);
+		if(r.ni != int(m.input.size()) || r.no != int(m.output.size()) || r.nh != int(m.memory.size()) || r.nw != m.weight_size()) {
+			return false;
+		}
+		std::shared_ptr<Genome> g = std::make_shared<Genome>(r.nw);
+		memcpy(g->weight.data(), r.weight(), sizeof(float)*r.nw);
+		m.genome = g;
+		m.origin = -1;
+		return true;
+	}
+	
+	// queues a mind, written by the next flush(); minds without an origin in this run
+	// came from the archive and are not stored again
+	void append(Kind k, double score, const Mind &m, const ArchiveMeta &meta) {
+		if(m.origin < 0 || !stored.insert(m.origin).second) {
+			return;
+		}
+		ArchiveRecord r;
+		r.score = score;
+		r.kind = k;
+		r.ni = m.input.size();
+		r.no = m.output.size();
+		r.nh = m.memory.size();
+		r.nw = m.weight_size();
+		r.seed = meta.seed;
+		r.uid = m.origin;
+		r.step = meta.step;
+		r.time = meta.time;
+		
+		int64_t o = pending.size();
+		pending.resize(o + ArchiveRecord::size(r.nw), 0);
+		memcpy(pending.data() + o, &r, sizeof(r));
+		memcpy(pending.data() + o + sizeof(r), m.weight(), sizeof(float)*r.nw);
+		pending_index.push_back(ArchiveEntry{r.score, r.kind, r.nw, o});
+	}
+	
+	void append(Kind k, const Selector &s, const ArchiveMeta &meta) {
+		for(const Champion &c : s.champions) {
+			append(k, c.score, c.mind, meta);
+		}
+	}
+	
+	// writes queued records and the merged index, then maps the grown archive
+	bool flush() {
+		if(fd < 0 || pending.empty()) {
+			return fd >= 0;
+		}
+		flock(fd, LOCK_EX);
+		// another run may have appended since the archive was mapped
+		bool ok = load();
+		if(ok) {
+			ArchiveHeader h = *header();
+			int64_t base = sizeof(ArchiveHeader) + h.size;
+			ok = pwrite(fd, pending.data(), pending.size(), base) == ssize_t(pending.size());
+			if(ok) {
+				std::vector<ArchiveEntry> list(index, index + index_count);
+				for(ArchiveEntry e : pending_index) {
+					e.offset += base;
+					list.push_back(e);
+				}
+				std::sort(list.begin(), list.end());
+				h.count += pending_index.size();
+				h.size += pending.size();
+				ok = pwrite(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h));
+				ok = ok && write_index(list);
+			}
+			ok = load() && ok;
+		}
+		flock(fd, LOCK_UN);
+		pending.clear();
+		pending_index.clear();
+		return ok;
+	}
+	
+	// puts the best minds of one species that fit the shape of `proto` among the champions
+	int seed(Selector &s, Kind k, const Mind &proto, int count) const {
+		std::list<Champion> list;
+		const ArchiveEntry *last = end(k);
+		for(const ArchiveEntry *e = begin(k); e != last && int(list.size()) < count; ++e) {
+			Mind m(proto);
+			if(get(*e, m)) {
+				list.push_front(Champion(e->score, m));
+			}
+		}
+		int n = list.size();
+		s.champions.merge(list);
+		s.select();
+		return n;
+	}
+};
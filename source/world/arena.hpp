@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "myworld.hpp"
+#include "setup.hpp"
+#include "random.hpp"
+
+// Fixed-seed scoring of minds outside of a live run.
+// Each mind is run through the same scenarios: the default layout, where the spawn of its
+// species produces only variations of that mind and the other species starts from random
+// minds. The fitness of a scenario is the mean score of the candidate's animals, counting the
+// dead ones and those still alive at the end. Scenarios are independent worlds and are
+// distributed over threads; the random generator is per thread, so results do not depend on
+// the number of threads.
+class Arena {
+private:
+	// sums the scores of one species
+	class Tally : public Listener {
+	public:
+		Kind kind;
+		double sum = 0.0;
+		long count = 0;
+		
+		Tally(Kind k) : kind(k) {}
+		
+		void died(Organism *e) override {
+			if(e->kind() == kind) {
+				sum += e->score();
+				count += 1;
+			}
+		}
+	};
+
+public:
+	struct Candidate {
+		Kind kind;
+		const Mind *mind;
+	};
+	
+	std::vector<unsigned> seeds;
+	long steps;
+	int threads;
+	// of the scenario worlds, it matches the shape of the candidate minds
+	Sensors sensors;
+	
+	// fitness of each candidate in each scenario, candidate-major
+	std::vector<double> scores;
+	
+	Arena(int scenarios = 4, long s = 10000, unsigned first_seed = 1, int t = 0) : steps(s) {
+		for(int i = 0; i < scenarios; ++i) {
+			seeds.push_back(first_seed + i);
+		}
+		threads = t > 0 ? t : std::max(1, int(std::thread::hardware_concurrency()));
+	}
+	
+	double run(const Candidate &c, unsigned seed) const {
+		rand_seed(seed);
+		MyWorld world(default_world_size);
+		world.sensors = sensors;
+		populate(world);
+		for(auto &p : world.entities) {
+			if(auto s = dynamic_cast<SpawnAnimal*>(p.second)) {
+				bool own = (c.kind == KIND_HERBIVORE) == (s->kind() == KIND_SPAWN_HERBIVORE);
+				const Mind *m = own ? c.mind : nullptr;
+				s->mindgen = [m](){return SpawnMind{m, true};};
+			}
+		}
+		
+		Tally tally(c.kind);
+		world.listeners.push_back(&tally);
+		for(long i = 0; i < steps; ++i) {
+			world.step();
+		}
+		world.listeners.remove(&tally);
+		for(auto &p : world.animals) {
+			tally.died(p.second);
+		}
+		return tally.count > 0 ? tally.sum/tally.count : 0.0;
+	}
+	
+	// mean fitness over the scenarios for each candidate
+	std::vector<double> evaluate(const std::vector<Candidate> &cands) {
+		int ns = seeds.size();
+		long jobs = long(cands.size())*ns;
+		scores.assign(jobs, 0.0);
+		
+		// the calling thread takes part, its own sequence is restored afterwards
+		std::string state = rand_state();
+		std::atomic<long> next(0);
+		auto work = [&]() {
+			for(long j = next++; j < jobs; j = next++) {
+				scores[j] = run(cands[j/ns], seeds[j%ns]);
+			}
+		};
+		std::vector<std::thread> pool;
+		for(int i = 1; i < std::min<long>(threads, jobs); ++i) {
+			pool.push_back(std::thread(work));
+		}
+		work();
+		for(std::thread &t : pool) {
+			t.join();
+		}
+		rand_restore(state);
+		
+		std::vector<double> fitness(cands.size(), 0.0);
+		for(long j = 0; j < jobs; ++j) {
+			fitness[j/ns] += scores[j]/ns;
+		}
+		return fitness;
+	}
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include "organism.hpp"
+#include "listener.hpp"
+
+// key of integer cell coordinates in sparse maps
+inline uint64_t cell_key(int i, int j) {
+	return (uint64_t(uint32_t(i)) << 32) | uint64_t(uint32_t(j));
+}
+
+struct Chunk {
+	int i, j;
+	std::vector<Organism*> items;
+};
+
+// Plants and animals by square chunk of the world. A chunk is allocated when the first
+// organism enters it and freed when the last one leaves, so memory follows the occupied
+// area, and queries only visit chunks that hold organisms.
+class Chunks : public Listener {
+public:
+	double width;
+	std::unordered_map<uint64_t, Chunk> map;
+	
+	Chunks(double w = 100.0) : width(w) {}
+	
+	int coord(double x) const {
+		return int(floor(x/width));
+	}
+	
+	static bool member(const Organism *e) {
+		return e->kind() != KIND_NONE && e->kind() < KIND_SPAWN_PLANT;
+	}
+	
+	void insert(Organism *e) {
+		int i = coord(e->pos.x()), j = coord(e->pos.y());
+		Chunk &c = map[cell_key(i, j)];
+		if(c.items.empty()) {
+			c.i = i;
+			c.j = j;
+		}
+		e->chunk = &c;
+		e->chunk_slot = int(c.items.size());
+		c.items.push_back(e);
+	}
+	
+	void erase(Organism *e) {
+		Chunk *c = e->chunk;
+		if(c == nullptr) {
+			return;
+		}
+		c->items[e->chunk_slot] = c->items.back();
+		c->items[e->chunk_slot]->chunk_slot = e->chunk_slot;
+		c->items.pop_back();
+		e->chunk = nullptr;
+		e->chunk_slot = -1;
+		if(c->items.empty()) {
+			map.erase(cell_key(c->i, c->j));
+		}
+	}
+	
+	// moves the organism to the chunk of its current position
+	void relocate(Organism *e) {
+		Chunk *c = e->chunk;
+		if(c != nullptr && (c->i != coord(e->pos.x()) || c->j != coord(e->pos.y()))) {
+			erase(e);
+			insert(e);
+		}
+	}
+	
+	// calls `f` for the organisms of the chunks that overlap the square of half size `r`
+	// around `x`, by scanning the range or the populated chunks, whichever is smaller
+	template <typename F>
+	void query(const vec2 &x, double r, F f) const {
+		int i0 = coord(x.x() - r), i1 = coord(x.x() + r);
+		int j0 = coord(x.y() - r), j1 = coord(x.y() + r);
+		if(double(i1 - i0 + 1)*double(j1 - j0 + 1) <= double(map.size())) {
+			for(int j = j0; j <= j1; ++j) {
+				for(int i = i0; i <= i1; ++i) {
+					auto it = map.find(cell_key(i, j));
+					if(it != map.end()) {
+						for(Organism *e : it->second.items) {
+							f(e);
+						}
+					}
+				}
+			}
+		} else {
+			for(auto &p : map) {
+				const Chunk &c = p.second;
+				if(c.i >= i0 && c.i <= i1 && c.j >= j0 && c.j <= j1) {
+					for(Organism *e : c.items) {
+						f(e);
+					}
+				}
+			}
+		}
+	}
+	
+	void added(Organism *e) override {
+		if(member(e)) {
+			insert(e);
+		}
+	}
+	
+	void died(Organism *e) override {
+		erase(e);
+	}
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+
+#include "random.hpp"
+#include "mind.hpp"
+#include "optimizer.hpp"
+#include "organism.hpp"
+
+// Separable natural evolution strategy over the weights of one species. Each generation
+// draws `pairs` mirrored perturbations of the mean, mean +- sigma*eps, and hands them to
+// spawns in turn, unmutated. Spawned animals are recognized by their genome when they
+// die and their fitness averaged per candidate; bred offspring do not count. Once every
+// candidate has `evals` samples, ranks are turned into utilities, which move the mean
+// along the estimated gradient and adapt the step size of every weight.
+//
+// Few spawned animals eat before they die, so the score alone ranks most candidates as
+// ties. The fitness adds the potential of its food the animal sensed over its life,
+// weighted by `forage`, which orders the candidates that ate nothing by how close to food
+// they kept.
+// The mean starts at the zero mind: a random one drives the recurrent layer into
+// saturation, where small perturbations barely change the behavior.
+class EvolutionStrategy : public Optimizer {
+private:
+	struct Candidate {
+		Mind mind;
+		double sum = 0.0;
+		long count = 0;
+		
+		Candidate(const Mind &m) : mind(m) {}
+		
+		double fitness() const {
+			return count > 0 ? sum/count : 0.0;
+		}
+	};
+	
+	int nw;
+	std::vector<float> mean, sigma;
+	// standard normal draws, one row per pair
+	std::vector<float> eps;
+	// +eps at 2k, -eps at 2k + 1
+	std::vector<Candidate> cands;
+	std::unordered_map<const Genome*, int> index;
+	int next = 0;
+	Mind center;
+	
+	void sample() {
+		eps.resize(size_t(pairs)*nw);
+		for(float &e : eps) {
+			e = float(rand_norm());
+		}
+		index.clear();
+		for(int i = 0; i < 2*pairs; ++i) {
+			const float *e = eps.data() + size_t(i/2)*nw;
+			float s = i % 2 == 0 ? 1.0f : -1.0f;
+			std::shared_ptr<Genome> g = std::make_shared<Genome>(nw);
+			for(int j = 0; j < nw; ++j) {
+				g->weight[j] = mean[j] + s*sigma[j]*e[j];
+			}
+			cands[i] = Candidate(center);
+			cands[i].mind.genome = g;
+			index[g.get()] = i;
+		}
+		next = 0;
+	}
+	
+	void update() {
+		int n = 2*pairs;
+		std::vector<int> rank(n);
+		for(int i = 0; i < n; ++i) {
+			rank[i] = i;
+		}
+		std::sort(rank.begin(), rank.end(), [this](int a, int b) {return cands[a].fitness() > cands[b].fitness();});
+		
+		// rank-based utilities, zero-sum and independent of the scale of scores
+		std::vector<double> u(n, 0.0);
+		double total = 0.0;
+		for(int r = 0; r < n; ++r) {
+			u[rank[r]] = std::max(0.0, log(0.5*n + 1.0) - log(r + 1.0));
+			total += u[rank[r]];
+		}
+		for(double &v : u) {
+			v = v/total - 1.0/n;
+		}
+		// most animals score nothing, tied candidates share their utility so that ties
+		// carry no direction
+		for(int r = 0; r < n;) {
+			int q = r;
+			double t = 0.0;
+			while(q < n && cands[rank[q]].fitness() == cands[rank[r]].fitness()) {
+				t += u[rank[q++]];
+			}
+			for(int k = r; k < q; ++k) {
+				u[rank[k]] = t/(q - r);
+			}
+			r = q;
+		}
+		
+		for(int j = 0; j < nw; ++j) {
+			double gm = 0.0, gs = 0.0;
+			for(int k = 0; k < pairs; ++k) {
+				double e = eps[size_t(k)*nw + j];
+				gm += (u[2*k] - u[2*k + 1])*e;
+				gs += (u[2*k] + u[2*k + 1])*(e*e - 1.0);
+			}
+			mean[j] += float(lr_mean*sigma[j]*gm);
+			sigma[j] *= float(exp(0.5*lr_sigma*gs));
+		}
+		
+		fitness = 0.0;
+		for(const Candidate &c : cands) {
+			fitness += c.fitness()/n;
+		}
+		generation += 1;
+		
+		std::shared_ptr<Genome> g = std::make_shared<Genome>(nw);
+		g->weight = mean;
+		center.genome = g;
+	}
+
+public:
+	int pairs;
+	// dead spawned animals per candidate before an update
+	int evals;
+	double lr_mean, lr_sigma;
+	// weight of the foraged potential in the fitness
+	double forage = 1.0;
+	
+	long generation = 0;
+	// mean fitness of the candidates of the last generation
+	double fitness = 0.0;
+	
+	// `proto` gives the shape of minds, the mean starts at the zero mind
+	EvolutionStrategy(const Mind &proto, double sigma0 = 0.3, int p = 16, int e = 4) : center(proto) {
+		nw = proto.weight_size();
+		pairs = p;
+		evals = e;
+		lr_mean = 1.0;
+		lr_sigma = (3.0 + log(double(nw)))/(5.0*sqrt(double(nw)));
+		
+		center.genome = std::make_shared<Genome>(nw);
+		center.origin = -1;
+		mean.assign(nw, 0.0f);
+		sigma.assign(nw, float(sigma0));
+		cands.assign(2*pairs, Candidate(center));
+		sample();
+	}
+	
+	void add(Animal *a) override {
+		auto it = index.find(a->mind.genome.get());
+		if(it != index.end()) {
+			cands[it->second].sum += a->score() + forage*a->foraged;
+			cands[it->second].count += 1;
+		}
+	}
+	
+	void select() override {
+		for(const Candidate &c : cands) {
+			if(c.count < evals) {
+				return;
+			}
+		}
+		update();
+		sample();
+	}
+	
+	const Mind *genMind() override {
+		const Mind *m = &cands[next].mind;
+		next = (next + 1) % int(cands.size());
+		return m;
+	}
+	
+	bool mutates() const override {
+		return false;
+	}
+	
+	const Mind *best() const override {
+		return &center;
+	}
+	
+	double mean_sigma() const {
+		double s = 0.0;
+		for(float v : sigma) {
+			s += v;
+		}
+		return s/nw;
+	}
+};
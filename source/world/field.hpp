@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+
+#include "organism.hpp"
+#include "listener.hpp"
+#include "chunks.hpp"
+
+struct FieldCell {
+	// sum of s, sum of s^2 and sum of s*pos over the plants of the cell
+	double mass = 0.0, mass2 = 0.0;
+	double mx = 0.0, my = 0.0;
+	
+	// plants below the cell
+	int count = 0;
+	
+	int level = 0, i = 0, j = 0;
+	FieldCell *parent = nullptr;
+	FieldCell *child[4] = {nullptr, nullptr, nullptr, nullptr};
+	
+	// finest level only
+	std::vector<Plant*> plants;
+};
+
+// Plant channel of the potential kept in a pyramid of grids with the aggregated plant
+// size (mass) of every cell. Plants never move, so the pyramid only changes on plant
+// birth, death, eating and growth, each touching one cell per level.
+//
+// Cells exist only where there are plants: each holds its parent and its four children,
+// so queries walk a sparse quadtree and memory follows the occupied area of the world.
+//
+// Queries open cells Barnes-Hut style: a cell that is small compared to its distance
+// is taken as one source at its center of mass, with a first order correction for the
+// source size in the kernel; finest cells that are too close are summed exactly.
+class PlantField : public Listener {
+private:
+	struct Level {
+		int nx, ny;
+		double width;
+		std::unordered_map<uint64_t, FieldCell> cells;
+	};
+	
+	vec2 origin;
+	std::vector<Level> levels;
+	
+	int ci(const Level &lv, double x) const {
+		int i = int(floor((x - origin.x())/lv.width));
+		return i < 0 ? 0 : (i >= lv.nx ? lv.nx - 1 : i);
+	}
+	int cj(const Level &lv, double y) const {
+		int j = int(floor((y - origin.y())/lv.width));
+		return j < 0 ? 0 : (j >= lv.ny ? lv.ny - 1 : j);
+	}
+	
+	// finds or creates a cell together with the missing cells above it
+	FieldCell *cell(int l, int i, int j) {
+		auto r = levels[l].cells.emplace(cell_key(i, j), FieldCell());
+		FieldCell *c = &r.first->second;
+		if(r.second) {
+			c->level = l;
+			c->i = i;
+			c->j = j;
+			if(l + 1 < int(levels.size())) {
+				c->parent = cell(l + 1, i/2, j/2);
+				c->parent->child[2*(j & 1) + (i & 1)] = c;
+			}
+		}
+		return c;
+	}
+	
+	// frees the empty cells from `c` upwards
+	void release(FieldCell *c) {
+		while(c != nullptr && c->count == 0) {
+			FieldCell *p = c->parent;
+			if(p != nullptr) {
+				p->child[2*(c->j & 1) + (c->i & 1)] = nullptr;
+			}
+			levels[c->level].cells.erase(cell_key(c->i, c->j));
+			c = p;
+		}
+	}
+	
+	void visit(const FieldCell *c, const vec2 &x, PG &pg) const {
+		if(c->mass <= 1e-9) {
+			return;
+		}
+		vec2 d = vec2(c->mx/c->mass, c->my/c->mass) - x;
+		double r = length(d);
+		if(levels[c->level].width < theta*r) {
+			double r2 = r*r;
+			pg.add(c->mass/r - c->mass2/r2, (c->mass/(r2*r) - 3.0*c->mass2/(r2*r2))*d);
+			return;
+		}
+		if(c->level == 0) {
+			for(const Plant *p : c->plants) {
+				pg.add(p->pos - x, p->field_size, p->field_size);
+			}
+			return;
+		}
+		for(const FieldCell *s : c->child) {
+			if(s != nullptr) {
+				visit(s, x, pg);
+			}
+		}
+	}
+
+public:
+	// opening angle, smaller is more exact
+	double theta = 0.2;
+	
+	// `half` is the half extent of the world, `width` the finest cell size
+	PlantField(const vec2 &half, double width = 25.0) {
+		origin = -half;
+		int nx = int(ceil(2*half.x()/width)), ny = int(ceil(2*half.y()/width));
+		nx = nx < 1 ? 1 : nx;
+		ny = ny < 1 ? 1 : ny;
+		for(;;) {
+			Level lv;
+			lv.nx = nx;
+			lv.ny = ny;
+			lv.width = width;
+			levels.push_back(lv);
+			if(nx == 1 && ny == 1) {
+				break;
+			}
+			nx = (nx + 1)/2;
+			ny = (ny + 1)/2;
+			width *= 2;
+		}
+	}
+	
+	// number of allocated cells over all levels
+	long cells() const {
+		long n = 0;
+		for(const Level &lv : levels) {
+			n += lv.cells.size();
+		}
+		return n;
+	}
+	
+	// accounts the current size of the plant
+	void update(Plant *p) {
+		double s = p->field_size, ns = p->size();
+		if(p->field_cell == nullptr) {
+			const Level &lv = levels[0];
+			FieldCell *c = cell(0, ci(lv, p->pos.x()), cj(lv, p->pos.y()));
+			p->field_cell = c;
+			p->field_slot = int(c->plants.size());
+			c->plants.push_back(p);
+			for(; c != nullptr; c = c->parent) {
+				c->count += 1;
+			}
+			s = 0.0;
+		}
+		double ds = ns - s, ds2 = ns*ns - s*s;
+		for(FieldCell *c = p->field_cell; c != nullptr; c = c->parent) {
+			c->mass += ds;
+			c->mass2 += ds2;
+			c->mx += ds*p->pos.x();
+			c->my += ds*p->pos.y();
+		}
+		p->field_size = ns;
+	}
+	
+	void remove(Plant *p) {
+		FieldCell *fc = p->field_cell;
+		if(fc == nullptr) {
+			return;
+		}
+		double s = p->field_size;
+		for(FieldCell *c = fc; c != nullptr; c = c->parent) {
+			c->mass -= s;
+			c->mass2 -= s*s;
+			c->mx -= s*p->pos.x();
+			c->my -= s*p->pos.y();
+			c->count -= 1;
+		}
+		std::vector<Plant*> &list = fc->plants;
+		list[p->field_slot] = list.back();
+		list[p->field_slot]->field_slot = p->field_slot;
+		list.pop_back();
+		release(fc);
+		p->field_cell = nullptr;
+		p->field_slot = -1;
+		p->field_size = 0.0;
+	}
+	
+	// potential and gradient of plants at `x`, not yet scaled by the size of the sensing organism
+	PG potential(const vec2 &x) const {
+		PG pg;
+		for(auto &p : levels.back().cells) {
+			visit(&p.second, x, pg);
+		}
+		return pg;
+	}
+	
+	void added(Organism *e) override {
+		if(e->kind() == KIND_PLANT) {
+			update(static_cast<Plant*>(e));
+		}
+	}
+	
+	void died(Organism *e) override {
+		if(e->kind() == KIND_PLANT) {
+			remove(static_cast<Plant*>(e));
+		}
+	}
+	
+	void ate(Animal *, Organism *food, double) override {
+		if(food->kind() == KIND_PLANT) {
+			update(static_cast<Plant*>(food));
+		}
+	}
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "organism.hpp"
+#include "chunks.hpp"
+
+// Uniform grid over organism circles, rebuilt from scratch once per step.
+// Cells keep organisms in one flat array ordered by cell, an organism is listed in every
+// cell its circle overlaps. Only occupied cells have an entry, so building and memory
+// follow the number of organisms, not the area of the world. Circles reaching outside
+// the world are kept in a separate list which every query checks.
+class Grid {
+public:
+	struct Hit {
+		Organism *e = nullptr;
+		double dist = 0.0;
+	};
+	
+	vec2 origin;
+	double width;
+	int nx, ny;
+	
+	// range of every occupied cell in `items`
+	std::unordered_map<uint64_t, std::pair<int, int>> cells;
+	std::vector<Organism*> items;
+	std::vector<Organism*> outside;
+
+private:
+	struct Entry {
+		uint64_t key;
+		Organism *e;
+	};
+	std::vector<Entry> entries;
+	
+	int cx(double x) const {
+		int i = int(floor((x - origin.x())/width));
+		return i < 0 ? 0 : (i >= nx ? nx - 1 : i);
+	}
+	int cy(double y) const {
+		int j = int(floor((y - origin.y())/width));
+		return j < 0 ? 0 : (j >= ny ? ny - 1 : j);
+	}
+	
+	// distance along the unit direction `d` from `o` to the circle, negative if missed
+	static double intersect(const vec2 &o, const vec2 &d, const vec2 &c, double r) {
+		vec2 m = o - c;
+		double b = m.x()*d.x() + m.y()*d.y();
+		double cc = m.x()*m.x() + m.y()*m.y() - r*r;
+		if(cc > 0.0 && b > 0.0) {
+			return -1.0;
+		}
+		double disc = b*b - cc;
+		if(disc < 0.0) {
+			return -1.0;
+		}
+		double t = -b - sqrt(disc);
+		return t < 0.0 ? 0.0 : t;
+	}
+
+public:
+	// `half` is the half extent of the world
+	Grid(const vec2 &half, double w) {
+		origin = -half;
+		width = w;
+		nx = std::max(1, int(ceil(2*half.x()/w)));
+		ny = std::max(1, int(ceil(2*half.y()/w)));
+	}
+	
+	template <typename Iter>
+	void build(Iter begin, Iter end) {
+		entries.clear();
+		outside.clear();
+		vec2 hi = origin + vec2(nx*width, ny*width);
+		for(Iter it = begin; it != end; ++it) {
+			Organism *e = *it;
+			double r = e->size();
+			if(e->pos.x() - r < origin.x() || e->pos.y() - r < origin.y() || e->pos.x() + r > hi.x() || e->pos.y() + r > hi.y()) {
+				outside.push_back(e);
+			}
+			int i0 = cx(e->pos.x() - r), i1 = cx(e->pos.x() + r);
+			int j0 = cy(e->pos.y() - r), j1 = cy(e->pos.y() + r);
+			for(int j = j0; j <= j1; ++j) {
+				for(int i = i0; i <= i1; ++i) {
+					entries.push_back(Entry{cell_key(i, j), e});
+				}
+			}
+		}
+		// stable, so that a cell lists organisms in the order they were given
+		std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {return a.key < b.key;});
+		
+		cells.clear();
+		items.resize(entries.size());
+		for(int k = 0, n = int(entries.size()); k < n;) {
+			int b = k;
+			uint64_t key = entries[k].key;
+			for(; k < n && entries[k].key == key; ++k) {
+				items[k] = entries[k].e;
+			}
+			cells[key] = std::make_pair(b, k);
+		}
+	}
+	
+	// nearest circle hit by testing every organism of [begin, end), the reference for raycast()
+	template <typename I>
+	static Hit scan(const vec2 &o, const vec2 &d, double range, const Organism *self, I begin, I end) {
+		Hit hit;
+		hit.dist = range;
+		for(I it = begin; it != end; ++it) {
+			test(o, d, *it, self, hit);
+		}
+		return hit;
+	}
+	
+	// nearest circle hit by the ray from `o` along the unit direction `d` within `range`,
+	// cells are walked in ray order (Amanatides-Woo) and the walk stops at the first cell
+	// that ends beyond the nearest hit
+	Hit raycast(const vec2 &o, const vec2 &d, double range, const Organism *self) const {
+		Hit hit;
+		hit.dist = range;
+		walk(o, d, self, hit);
+		for(Organism *e : outside) {
+			test(o, d, e, self, hit);
+		}
+		return hit;
+	}
+
+private:
+	static void test(const vec2 &o, const vec2 &d, Organism *e, const Organism *self, Hit &hit) {
+		if(e == self) {
+			return;
+		}
+		double t = intersect(o, d, e->pos, e->size());
+		if(t >= 0.0 && t < hit.dist) {
+			hit.dist = t;
+			hit.e = e;
+		}
+	}
+	
+	void walk(const vec2 &o, const vec2 &d, const Organism *self, Hit &hit) const {
+		double range = hit.dist;
+		
+		// clip the ray to the grid
+		double t0 = 0.0, t1 = range;
+		vec2 lo = origin, hi = origin + vec2(nx*width, ny*width);
+		for(int k = 0; k < 2; ++k) {
+			if(fabs(d[k]) < 1e-12) {
+				if(o[k] < lo[k] || o[k] > hi[k]) {
+					return;
+				}
+				continue;
+			}
+			double ta = (lo[k] - o[k])/d[k], tb = (hi[k] - o[k])/d[k];
+			if(ta > tb) {
+				std::swap(ta, tb);
+			}
+			t0 = std::max(t0, ta);
+			t1 = std::min(t1, tb);
+		}
+		if(t0 > t1) {
+			return;
+		}
+		
+		vec2 p = o + t0*d;
+		int i = cx(p.x()), j = cy(p.y());
+		int si = d.x() > 0.0 ? 1 : -1, sj = d.y() > 0.0 ? 1 : -1;
+		double inf = 2*range + 1.0;
+		double tdx = fabs(d.x()) > 1e-12 ? width/fabs(d.x()) : inf;
+		double tdy = fabs(d.y()) > 1e-12 ? width/fabs(d.y()) : inf;
+		double tmx = fabs(d.x()) > 1e-12 ? (origin.x() + (i + (si > 0 ? 1 : 0))*width - o.x())/d.x() : inf;
+		double tmy = fabs(d.y()) > 1e-12 ? (origin.y() + (j + (sj > 0 ? 1 : 0))*width - o.y())/d.y() : inf;
+		
+		for(;;) {
+			auto ci = cells.find(cell_key(i, j));
+			if(ci != cells.end()) {
+				for(int k = ci->second.first; k < ci->second.second; ++k) {
+					test(o, d, items[k], self, hit);
+				}
+			}
+			double exit = std::min(tmx, tmy);
+			if(hit.e != nullptr && hit.dist <= exit) {
+				break;
+			}
+			if(exit > t1) {
+				break;
+			}
+			if(tmx < tmy) {
+				i += si;
+				tmx += tdx;
+			} else {
+				j += sj;
+				tmy += tdy;
+			}
+			if(i < 0 || i >= nx || j < 0 || j >= ny) {
+				break;
+			}
+		}
+	}
+};
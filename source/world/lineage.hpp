@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "organism.hpp"
+#include "listener.hpp"
+
+// Genealogy of animals by genetic parent (Mind::origin), so animals spawned from
+// a champion descend from that champion.
+//
+// Only ancestry of living or held (champion) animals is kept: dead leaves are
+// removed and dead nodes with a single child are spliced out, so the store holds
+// at most twice as many nodes as there are living and held animals regardless of
+// how many births happened. Depth is the absolute generation and survives splicing.
+class Lineage : public Listener {
+public:
+	struct Node {
+		// nearest stored ancestor
+		long parent = -1;
+		// xor of child uids, which is the child itself when there is only one
+		long child_xor = 0;
+		int children = 0;
+		int holds = 0;
+		int depth = 0;
+		long birth = 0;
+		Kind kind = KIND_NONE;
+		bool alive = true;
+	};
+	
+	const long &step;
+	std::unordered_map<long, Node> nodes;
+	long pruned = 0;
+	
+	Lineage(const long &s) : step(s) {}
+	
+private:
+	Node *find(long uid) {
+		auto it = nodes.find(uid);
+		return it != nodes.end() ? &it->second : nullptr;
+	}
+	
+	void prune(long uid) {
+		for(;;) {
+			auto it = nodes.find(uid);
+			if(it == nodes.end()) {
+				return;
+			}
+			Node &n = it->second;
+			if(n.alive || n.holds > 0 || n.children > 1) {
+				return;
+			}
+			Node *p = find(n.parent);
+			if(n.children == 1) {
+				long c = n.child_xor;
+				nodes[c].parent = n.parent;
+				if(p != nullptr) {
+					p->child_xor ^= uid ^ c;
+				}
+				nodes.erase(it);
+				pruned += 1;
+				return;
+			}
+			long pu = n.parent;
+			nodes.erase(it);
+			pruned += 1;
+			if(p == nullptr) {
+				return;
+			}
+			p->children -= 1;
+			p->child_xor ^= uid;
+			uid = pu;
+		}
+	}
+	
+public:
+	void added(Organism *e) override {
+		Animal *a = dynamic_cast<Animal*>(e);
+		if(a == nullptr) {
+			return;
+		}
+		Node n;
+		n.birth = step - a->age;
+		n.kind = a->kind();
+		if(Node *p = find(a->mind.origin)) {
+			n.parent = a->mind.origin;
+			n.depth = p->depth + 1;
+			p->children += 1;
+			p->child_xor ^= a->uid;
+		}
+		nodes[a->uid] = n;
+	}
+	
+	void died(Organism *e) override {
+		if(Node *n = find(e->uid)) {
+			n->alive = false;
+			prune(e->uid);
+		}
+	}
+	
+	// keeps a dead animal as a possible ancestor, e.g. while its mind is a champion
+	void hold(long uid) {
+		if(Node *n = find(uid)) {
+			n->holds += 1;
+		}
+	}
+	void release(long uid) {
+		Node *n = find(uid);
+		if(n != nullptr && n->holds > 0) {
+			n->holds -= 1;
+			prune(uid);
+		}
+	}
+	
+	int depth(long uid) {
+		Node *n = find(uid);
+		return n != nullptr ? n->depth : -1;
+	}
+	
+	// founder of the lineage, an animal with a random mind or whose ancestry was not kept
+	long root(long uid) {
+		Node *n = find(uid);
+		while(n != nullptr && n->parent >= 0) {
+			uid = n->parent;
+			n = find(uid);
+		}
+		return n != nullptr ? uid : -1;
+	}
+	
+	// most recent common ancestor, -1 if the lineages are unrelated
+	long mrca(long a, long b) {
+		Node *na = find(a), *nb = find(b);
+		while(na != nullptr && nb != nullptr && a != b) {
+			if(na->depth >= nb->depth) {
+				a = na->parent;
+				na = find(a);
+			} else {
+				b = nb->parent;
+				nb = find(b);
+			}
+		}
+		return na != nullptr && nb != nullptr ? a : -1;
+	}
+	
+	// common ancestor of all living animals of a kind
+	long mrca(Kind k) {
+		long m = -1;
+		bool first = true;
+		for(auto &p : nodes) {
+			if(p.second.alive && p.second.kind == k) {
+				m = first ? p.first : mrca(m, p.first);
+				first = false;
+				if(m < 0) {
+					break;
+				}
+			}
+		}
+		return m;
+	}
+	
+	// number of living animals in the clade of every stored node
+	std::unordered_map<long, long> clade_sizes() const {
+		std::vector<std::pair<int, long>> order;
+		order.reserve(nodes.size());
+		for(auto &p : nodes) {
+			order.push_back(std::make_pair(p.second.depth, p.first));
+		}
+		std::sort(order.begin(), order.end());
+		
+		std::unordered_map<long, long> sizes;
+		for(auto it = order.rbegin(); it != order.rend(); ++it) {
+			const Node &n = nodes.at(it->second);
+			long &s = sizes[it->second];
+			s += n.alive ? 1 : 0;
+			if(n.parent >= 0) {
+				sizes[n.parent] += s;
+			}
+		}
+		return sizes;
+	}
+	
+	long clade_size(long uid) const {
+		std::unordered_map<long, long> sizes = clade_sizes();
+		auto it = sizes.find(uid);
+		return it != sizes.end() ? it->second : 0;
+	}
+	
+	// founder with the most living descendants of a kind
+	long dominant(Kind k) {
+		std::unordered_map<long, long> counts;
+		for(auto &p : nodes) {
+			if(p.second.alive && p.second.kind == k) {
+				counts[root(p.first)] += 1;
+			}
+		}
+		long best = -1, size = 0;
+		for(auto &p : counts) {
+			if(p.second > size) {
+				best = p.first;
+				size = p.second;
+			}
+		}
+		return best;
+	}
+	
+	// one line per stored node: uid, parent, depth, birth step, kind, alive, held
+	bool save(const char *path) const {
+		FILE *f = fopen(path, "w");
+		if(f == nullptr) {
+			return false;
+		}
+		fprintf(f, "uid,parent,depth,birth,kind,alive,held\n");
+		for(auto &p : nodes) {
+			const Node &n = p.second;
+			fprintf(f, "%ld,%ld,%d,%ld,%d,%d,%d\n", p.first, n.parent, n.depth, n.birth, int(n.kind), int(n.alive), int(n.holds > 0));
+		}
+		fclose(f);
+		return true;
+	}
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <list>
+
+class Organism;
+class Animal;
+
+// Observer of world events, all callbacks are called from the step thread.
+class Listener {
+public:
+	virtual ~Listener() {}
+	
+	// any insertion into the world, including initial layout and restored state
+	virtual void added(Organism *e) {}
+	// parent is the spawn or the animal that produced the organism, called after added()
+	virtual void born(Organism *e, Organism *parent) {}
+	virtual void died(Organism *e) {}
+	// `energy` is taken from the food, the eater gains its eat_factor share
+	virtual void ate(Animal *e, Organism *food, double energy) {}
+	virtual void stepped(long step) {}
+};
+
+// Forwards events to a list of listeners
+class Dispatcher : public Listener {
+public:
+	std::list<Listener*> list;
+	
+	void push_back(Listener *l) {
+		list.push_back(l);
+	}
+	void remove(Listener *l) {
+		list.remove(l);
+	}
+	
+	void added(Organism *e) override {
+		for(Listener *l : list) {
+			l->added(e);
+		}
+	}
+	void born(Organism *e, Organism *parent) override {
+		for(Listener *l : list) {
+			l->born(e, parent);
+		}
+	}
+	void died(Organism *e) override {
+		for(Listener *l : list) {
+			l->died(e);
+		}
+	}
+	void ate(Animal *e, Organism *food, double energy) override {
+		for(Listener *l : list) {
+			l->ate(e, food, energy);
+		}
+	}
+	void stepped(long step) override {
+		for(Listener *l : list) {
+			l->stepped(step);
+		}
+	}
+};
@@ -1,17 +1,181 @@
 #pragma once
 
+#include <cmath>
 #include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <utility>
 
 #include <core/world.hpp>
 
+#include <governor.hpp>
+#include <trace.hpp>
+
 #include "organism.hpp"
+#include "spawn.hpp"
 #include "selector.hpp"
+#include "listener.hpp"
+#include "stats.hpp"
+#include "lineage.hpp"
+#include "field.hpp"
+#include "grid.hpp"
+#include "schedule.hpp"
+#include "chunks.hpp"
+#include "neighbors.hpp"
+#include "parallel.hpp"
 
 class MyWorld : public World {
 public:
 	Selector hsel, csel;
+	// minds of spawned animals, the selectors unless replaced
+	Optimizer *hopt = &hsel, *copt = &csel;
+	
+	// of the animals created by the world, set before it is populated
+	Sensors sensors;
+	
+	long step_index = 0;
+	long next_uid = 0;
+	
+	// number of steps started: organisms added now are first processed in step `clock`,
+	// both inside a step and between steps
+	long clock = 0;
+	
+	// Adaptive timestep: the step is chosen so that no organism travels further than
+	// `courant` times the smallest contact radius of an eater and its food, within
+	// [dt_min, dt_max]. The move phase is split into substeps so that heading changes by
+	// at most `max_turn` per substep. Eating uses a swept test, so `courant` may exceed
+	// one. Energy costs, growth, spawn timers and aging are given per step of `dt_ref`,
+	// the fixed step of the framework, and scaled by dt/dt_ref.
+	bool adaptive = false;
+	double dt = 1e-2, dt_min = 1e-3, dt_max = 1e-1, dt_ref = 1e-2;
+	double courant = 2.0, max_turn = 0.2;
+	int max_substeps = 16;
+	double time = 0.0;
+	
+	// gathered during process() for the timestep choice
+	double max_speed = 0.0, max_spin = 0.0, min_radius = 0.0;
+	
+	Dispatcher listeners;
+	Stats stats;
+	Lineage lineage;
+	
+	// Straightforward passes the fast ones are checked against, see shadow.hpp: sensing
+	// sums the potential over all entities, eating tests all pairs, eye rays test all
+	// bodies, all on the step thread.
+	bool reference = false;
+	
+	// plants are sensed through the cached field, animals through their own registry,
+	// so the sense phase does not scan plants
+	bool plant_field = true;
+	PlantField field;
+	std::map<long, Animal*> animals;
+	
+	// plants and animals by chunk, for the interaction broad phase and chunk-ordered passes
+	Chunks chunks;
+	std::vector<Organism*> near, more;
+	// contact partners kept across steps, the chunks are queried when they are rebuilt
+	Neighbors neighbors;
+	
+	// threads of the phases that run in parallel over the animals
+	Parallel parallel;
+	
+	// broad phase for the eye rays, rebuilt every step when eyes are configured
+	Grid grid;
+	std::vector<Organism*> bodies;
+	
+	// organisms processed every step: spawns, animals and plants that are still growing,
+	// saturated plants sleep in the scheduler
+	std::map<long, Organism*> active;
+	PlantScheduler scheduler;
+	std::vector<Organism*> dead;
+	
+	// steps without production because of the memory budgets
+	long throttled = 0;
 	
-	MyWorld(const vec2 &s) : World(s) {}
+	// paces the stepping loop of an interactive session to a target number of steps per
+	// second, waited on in sync() so the loop of World keeps its pause and locking
+	Governor governor;
+	
+	typedef decltype(World::entities) Entities;
+	std::map<long, Entities::iterator> where;
+	
+	MyWorld(const vec2 &s, int threads = 1) :
+		World(s), stats(clock), lineage(clock), field(s), neighbors(chunks), parallel(threads), grid(s, 50.0), scheduler(step_index, active)
+	{
+		listeners.push_back(&stats);
+		listeners.push_back(&lineage);
+		listeners.push_back(&field);
+		listeners.push_back(&scheduler);
+		listeners.push_back(&chunks);
+		listeners.push_back(&neighbors);
+		for(Selector *sel : {&hsel, &csel}) {
+			sel->admitted = [this](long uid){lineage.hold(uid);};
+			sel->evicted = [this](long uid){lineage.release(uid);};
+		}
+		dt = dt_ref = framework_dt();
+	}
+	
+	// The framework does not tell its fixed step, it hands it to the entities it moves: a
+	// probe alone in the world is moved once and keeps what it was given.
+	double framework_dt() {
+		struct Probe : public Entity {
+			double dt = 0.0;
+			void move(double d) override {
+				dt = d;
+			}
+		} probe;
+		probe.active = true;
+		auto it = entities.insert(std::make_pair(-1L, static_cast<Entity*>(&probe))).first;
+		World::move();
+		entities.erase(it);
+		return probe.dt;
+	}
+	
+	// estimated bytes of an organism with its entries in the registries of the world
+	static size_t footprint(const Organism *e) {
+		static const size_t node = 64;
+		switch(e->kind()) {
+		case KIND_PLANT:
+			return sizeof(Plant) + 3*node;
+		case KIND_HERBIVORE:
+			return sizeof(Herbivore) + 4*node + static_cast<const Animal*>(e)->mind.footprint();
+		case KIND_CARNIVORE:
+			return sizeof(Carnivore) + 4*node + static_cast<const Animal*>(e)->mind.footprint();
+		case KIND_SPAWN_PLANT:
+			return sizeof(SpawnPlant) + 3*node;
+		case KIND_SPAWN_HERBIVORE:
+			return sizeof(SpawnHerbivore) + 3*node;
+		case KIND_SPAWN_CARNIVORE:
+			return sizeof(SpawnCarnivore) + 3*node;
+		default:
+			return sizeof(Organism) + 3*node;
+		}
+	}
+	
+	void add(Organism *e) {
+		if(e->uid < 0) {
+			e->uid = next_uid++;
+		}
+		e->memory.set(footprint(e));
+		if(auto s = dynamic_cast<SpawnAnimal*>(e)) {
+			s->sensors = sensors;
+		}
+		if(auto s = dynamic_cast<SpawnHerbivore*>(e)) {
+			s->mindgen = [this](){return SpawnMind{hopt->genMind(), hopt->mutates()};};
+		} else if(auto s = dynamic_cast<SpawnCarnivore*>(e)) {
+			s->mindgen = [this](){return SpawnMind{copt->genMind(), copt->mutates()};};
+		}
+		e->listener = &listeners;
+		e->prev = e->pos;
+		if(auto a = dynamic_cast<Animal*>(e)) {
+			animals[a->uid] = a;
+		}
+		active[e->uid] = e;
+		// keyed as World::add does, the insertion gives the iterator
+		where[e->uid] = entities.insert(std::make_pair(id_counter++, static_cast<Entity*>(e))).first;
+		listeners.added(e);
+	}
 	
 	std::vector<PG> potential(Organism *e, std::vector<std::function<bool(Organism*)>> selectors) {
 		std::vector<PG> pl;
@@ -22,21 +186,13 @@ public:
 			for(int i = 0; i < int(pl.size()); ++i) {
 				// double spot = 20*e->size();
 				if(selectors[i](p)) { // && length(p->pos - e->pos) - p->size() < spot) {
-					vec2 d = p->pos - e->pos;
-					double l = length(d) + p->size();
-					double m = p->size()/e->size();
-					pl[i].pot += m/l;
-					pl[i].grad += m*d/(l*l*l);
+					pl[i].add(p->pos - e->pos, p->size(), p->size()/e->size());
 				}
 			}
 		}
 		
 		for(int i = 0; i < int(pl.size()); ++i) {
-			double lg = length(pl[i].grad);
-			if(lg < 1e-8)
-				pl[i].grad = nullvec2;
-			else
-				pl[i].grad = normalize(pl[i].grad);
+			pl[i].finish();
 		}
 		
 		return pl;
@@ -46,63 +202,360 @@ public:
 		Animal *anim = dynamic_cast<Animal*>(e);
 		if(anim == nullptr)
 			return;
+		// eaten in this step, it has no size to weigh the sources by and dies in its process
+		if(anim->energy <= 0.0)
+			return;
 		
-		anim->sense(potential(anim, std::vector<std::function<bool(Organism*)>>({
-			[](Organism *e) {return dynamic_cast<Plant*>(e) != nullptr;},
-			[anim](Organism *e) {return dynamic_cast<Herbivore*>(e) != nullptr && e != anim;},
-			[anim](Organism *e) {return dynamic_cast<Carnivore*>(e) != nullptr && e != anim;}
-		})));
+		if(reference || !plant_field) {
+			anim->sense(potential(anim, std::vector<std::function<bool(Organism*)>>({
+				[](Organism *e) {return dynamic_cast<Plant*>(e) != nullptr;},
+				[anim](Organism *e) {return dynamic_cast<Herbivore*>(e) != nullptr && e != anim;},
+				[anim](Organism *e) {return dynamic_cast<Carnivore*>(e) != nullptr && e != anim;}
+			})));
+			return;
+		}
+		
+		double is = 1.0/anim->size();
+		std::vector<PG> pl(3);
+		pl[0] = field.potential(anim->pos);
+		pl[0].scale(is);
+		// the animals as exchanged at the start of the phase, in uid order
+		for(const Body &b : parallel.bodies) {
+			if(b.uid != anim->uid) {
+				pl[b.kind == KIND_HERBIVORE ? 1 : 2].add(b.pos - anim->pos, b.size, b.size*is);
+			}
+		}
+		for(PG &pg : pl) {
+			pg.finish();
+		}
+		anim->sense(pl);
 	}
 	
-	void process() {
+	// Same pairs in the same order as the all-pairs pass of World, with the partners of an
+	// organism taken from its neighbor list, or from the chunks within its reach when the
+	// list no longer covers it: an animal eats prey whose circles touch over the last move,
+	// a spawn counts its own organisms within its radius. An animal that grows by eating
+	// reaches further, so its partners are gathered again unless its list still covers it.
+	void interact() {
+		if(reference) {
+			interact_all();
+			return;
+		}
+		double max_move = 0.0, max_size = scheduler.max_size();
+		for(auto &p : active) {
+			Organism *e = p.second;
+			if(e->kind() < KIND_SPAWN_PLANT) {
+				max_move = std::max(max_move, length(e->pos - e->prev));
+				max_size = std::max(max_size, e->size());
+			}
+		}
+		auto reach = [&](Organism *a) -> double {
+			if(auto s = dynamic_cast<Spawn*>(a)) {
+				return s->rad;
+			}
+			return 0.8*(a->size() + max_size) + 2.0*(length(a->pos - a->prev) + max_move) + 1e-6;
+		};
+		{
+			TraceSpan t("neighbors");
+			neighbors.update(reach);
+		}
+		
+		auto by_uid = [](const Organism *a, const Organism *b) {return a->uid < b->uid;};
+		for(auto &p : active) {
+			Organism *a = p.second;
+			Animal *anim = dynamic_cast<Animal*>(a);
+			Spawn *spawn = dynamic_cast<Spawn*>(a);
+			if(!a->active || (anim == nullptr && (spawn == nullptr || spawn->max_count <= 0))) {
+				continue;
+			}
+			if(anim != nullptr) {
+				anim->swept = adaptive;
+			}
+			
+			near.clear();
+			const Neighbors::List *list = neighbors.find(a);
+			if(list != nullptr && neighbors.covers(*list, reach(a))) {
+				for(Organism *e : list->items) {
+					if(e->interactive) {
+						near.push_back(e);
+					}
+				}
+			} else {
+				if(list != nullptr) {
+					neighbors.fallbacks += 1;
+					list = nullptr;
+				}
+				chunks.query(a->pos, reach(a), [&](Organism *e) {
+					if(e != a && e->interactive) {
+						near.push_back(e);
+					}
+				});
+				std::sort(near.begin(), near.end(), by_uid);
+			}
+			
+			double size = a->size();
+			for(size_t k = 0; k < near.size(); ++k) {
+				a->interact(near[k]);
+				if(a->size() > size) {
+					size = a->size();
+					max_size = std::max(max_size, size);
+					if(list != nullptr && neighbors.covers(*list, reach(a))) {
+						continue;
+					}
+					if(list != nullptr) {
+						neighbors.fallbacks += 1;
+						list = nullptr;
+					}
+					long last = near[k]->uid;
+					more.clear();
+					chunks.query(a->pos, reach(a), [&](Organism *e) {
+						if(e->uid > last && e != a && e->interactive) {
+							more.push_back(e);
+						}
+					});
+					std::sort(more.begin(), more.end(), by_uid);
+					near.resize(k + 1);
+					near.insert(near.end(), more.begin(), more.end());
+				}
+			}
+		}
+	}
+	
+	// every organism against every other, in uid order
+	void interact_all() {
+		for(auto &p : active) {
+			Organism *a = p.second;
+			Animal *anim = dynamic_cast<Animal*>(a);
+			Spawn *spawn = dynamic_cast<Spawn*>(a);
+			if(!a->active || (anim == nullptr && (spawn == nullptr || spawn->max_count <= 0))) {
+				continue;
+			}
+			if(anim != nullptr) {
+				anim->swept = adaptive;
+			}
+			for(auto &q : where) {
+				Organism *e = static_cast<Organism*>(q.second->second);
+				if(e != a && e->interactive) {
+					a->interact(e);
+				}
+			}
+		}
+	}
+	
+	// casts the eye rays of all animals against one grid built for the step
+	void look() {
+		const Sensors &sc = sensors;
+		if(sc.eyes <= 0) {
+			return;
+		}
+		bodies.clear();
 		for(auto &p : entities) {
-			static_cast<Organism*>(p.second)->process();
+			Organism *e = static_cast<Organism*>(p.second);
+			if(e->kind() < KIND_SPAWN_PLANT) {
+				bodies.push_back(e);
+			}
+		}
+		if(reference) {
+			for(auto &p : animals) {
+				Animal *a = p.second;
+				for(int k = 0; k < sc.eyes; ++k) {
+					double ang = sc.angle(k), ca = cos(ang), sa = sin(ang);
+					vec2 d(ca*a->dir.x() - sa*a->dir.y(), sa*a->dir.x() + ca*a->dir.y());
+					Grid::Hit h = Grid::scan(a->pos, d, sc.range, a, bodies.begin(), bodies.end());
+					a->see(k, h.e, h.dist);
+				}
+			}
+			return;
+		}
+		grid.build(bodies.begin(), bodies.end());
+		
+		parallel.each(animals, [this, &sc](Animal *a) {
+			for(int k = 0; k < sc.eyes; ++k) {
+				double ang = sc.angle(k), ca = cos(ang), sa = sin(ang);
+				vec2 d(ca*a->dir.x() - sa*a->dir.y(), sa*a->dir.x() + ca*a->dir.y());
+				Grid::Hit h = grid.raycast(a->pos, d, sc.range, a);
+				a->see(k, h.e, h.dist);
+			}
+		});
+	}
+	
+	void process() {
+		max_speed = 0.0;
+		max_spin = 0.0;
+		double min_eater = -1.0, min_food = -1.0;
+		// the last move took `dt`
+		double tick = adaptive ? dt/dt_ref : 1.0;
+		scheduler.advance();
+		for(auto ii = active.begin(); ii != active.end();) {
+			Organism *e = ii->second;
+			double e0 = e->energy;
+			e->process(tick);
+			stats.drift(e, e->energy - e0);
+			if(e->energy != e0 && e->kind() == KIND_PLANT) {
+				field.update(static_cast<Plant*>(e));
+			}
+			
+			e->prev = e->pos;
+			if(auto a = dynamic_cast<Animal*>(e)) {
+				max_speed = std::max(max_speed, length(a->vel));
+				max_spin = std::max(max_spin, fabs(a->spin));
+				if(min_eater < 0.0 || a->size() < min_eater) {
+					min_eater = a->size();
+				}
+			}
+			if(e->kind() < KIND_SPAWN_PLANT && (min_food < 0.0 || e->size() < min_food)) {
+				min_food = e->size();
+			}
+			
+			// the scheduler counts the age of sleeping plants in steps, so with the
+			// adaptive step plants stay awake
+			if(!e->alive) {
+				dead.push_back(e);
+			} else if(!adaptive && e->kind() == KIND_PLANT && static_cast<Plant*>(e)->saturated()) {
+				scheduler.sleep(static_cast<Plant*>(e));
+				active.erase(ii++);
+				continue;
+			}
+			++ii;
 		}
+		min_radius = 0.8*(std::max(min_eater, 0.0) + std::max(min_food, 0.0));
+	}
+	
+	void move() {
+		if(!adaptive) {
+			World::move();
+		} else {
+			step_adaptive();
+		}
+		for(auto &p : animals) {
+			Animal *a = p.second;
+			if(sizeof(real) < sizeof(double)) {
+				a->pos = snap(a->pos);
+				a->vel = snap(a->vel);
+				a->dir = snap(a->dir);
+			}
+			chunks.relocate(a);
+		}
+	}
+	
+	void step_adaptive() {		
+		dt = dt_max;
+		if(max_speed*dt > courant*min_radius) {
+			dt = std::max(dt_min, courant*min_radius/max_speed);
+		}
+		int n = std::min(max_substeps, std::max(1, int(ceil(max_spin*dt/max_turn))));
+		double h = dt/n;
+		// animals move independently, all substeps of one animal at once
+		parallel.each(animals, [n, h](Animal *a) {
+			for(int i = 0; i < n; ++i) {
+				a->move(h);
+			}
+		});
+		time += dt;
 	}
 	
 	void remove_dead() {
-		for(auto ii = entities.begin(); ii != entities.end();) {
-			Organism *e = static_cast<Organism*>(ii->second);
-			if(e->alive) {
-				++ii;
-			} else {
-				entities.erase(ii++);
-				if(auto h = dynamic_cast<Herbivore*>(e)) {
-					hsel.add(h);
-				} else if(auto c = dynamic_cast<Carnivore*>(e)) {
-					csel.add(c);
+		// in creation order, as a scan of entities would find them
+		std::sort(dead.begin(), dead.end(), [](const Organism *a, const Organism *b) {return a->uid < b->uid;});
+		for(Organism *e : dead) {
+			auto wi = where.find(e->uid);
+			entities.erase(wi->second);
+			where.erase(wi);
+			active.erase(e->uid);
+			animals.erase(e->uid);
+			if(auto h = dynamic_cast<Herbivore*>(e)) {
+				hsel.add(h);
+				if(hopt != &hsel) {
+					hopt->add(h);
+				}
+			} else if(auto c = dynamic_cast<Carnivore*>(e)) {
+				csel.add(c);
+				if(copt != &csel) {
+					copt->add(c);
 				}
-				delete e;
 			}
+			listeners.died(e);
+			delete e;
 		}
+		dead.clear();
 	}
 	
+	// Production pauses while organisms are over budget: spawns and breeders hold their
+	// state and produce once memory is released by deaths.
 	void reproduce() {
-		for(auto &p : entities) {
-			Organism *e = static_cast<Organism*>(p.second);
+		if(Memory::get().over(MEM_ORGANISMS)) {
+			throttled += 1;
+			return;
+		}
+		for(auto &p : active) {
+			Organism *e = p.second;
+			bool alive = e->alive;
 			std::list<Organism*> prod = e->produce();
 			for(Organism *ne : prod) {
 				add(ne);
+				listeners.born(ne, e);
+			}
+			if(alive && !e->alive) {
+				dead.push_back(e);
 			}
 		}
 	}
 	
 	void step() override {
-		interact();
+		TraceSpan ts("step");
+		clock = step_index + 1;
 		
-		// sense
-		for(auto &p : entities) {
-			sense(static_cast<Organism*>(p.second));
+		{
+			TraceSpan t("interact");
+			interact();
 		}
 		
-		process();
+		// sense, share by share in parallel; the order does not matter
+		{
+			TraceSpan t("sense");
+			parallel.exchange(animals);
+			parallel.each(animals, [this](Animal *a) {
+				sense(a);
+			});
+		}
+		{
+			TraceSpan t("look");
+			look();
+		}
 		
-		reproduce();
+		{
+			TraceSpan t("process");
+			process();
+		}
+		
+		{
+			TraceSpan t("reproduce");
+			reproduce();
+		}
 		
-		remove_dead();
-		hsel.select();
-		csel.select();
+		{
+			TraceSpan t("remove dead");
+			remove_dead();
+		}
+		{
+			TraceSpan t("select");
+			hsel.select();
+			csel.select();
+			if(hopt != &hsel) {
+				hopt->select();
+			}
+			if(copt != &csel) {
+				copt->select();
+			}
+		}
+		
+		{
+			TraceSpan t("move");
+			move();
+		}
 		
-		move();
+		step_index += 1;
+		TraceSpan t("listeners");
+		listeners.stepped(step_index);
 	}
 };
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include <memory.hpp>
+
+#include "organism.hpp"
+#include "spawn.hpp"
+#include "chunks.hpp"
+#include "listener.hpp"
+
+// Verlet lists of the contact phase: every animal and every spawn that counts its organisms
+// keeps the plants and animals within its contact reach plus a `skin`, in uid order, built
+// from the chunks. A list stays valid while the reach of its owner, grown by how far the
+// owner and any other organism moved since the list was made, still fits in it, so the
+// contact phase scans the lists and the broad phase only runs once the skin is used up.
+//
+// Lists are made from the anchors of organisms, their positions at the last rebuild or
+// when they were added after it; plants do not move, their anchor is their position.
+// Organisms added since the last update are merged into the lists at the next one. Dead
+// organisms are dropped from the lists right away: deaths come between the contact phase
+// and the move, so the displacements of the last update still bound where the owners are.
+class Neighbors : public Listener {
+public:
+	struct List {
+		Organism *owner;
+		vec2 anchor;
+		double radius = 0.0;
+		// made since the last update, the list is still empty
+		bool fresh = true;
+		std::vector<Organism*> items;
+	};
+
+private:
+	const Chunks &chunks;
+	std::unordered_map<long, List> lists;
+	std::vector<List*> spawns;
+	// added since the last update
+	std::vector<Organism*> fresh;
+	bool built = false;
+	// largest anchor displacement and largest list radius of the animals
+	double max_disp = 0.0, max_radius = 0.0;
+	
+	MemoryCharge memory = MemoryCharge(MEM_ORGANISMS);
+	
+	static bool owner(const Organism *e) {
+		if(auto s = dynamic_cast<const Spawn*>(e)) {
+			return s->max_count > 0;
+		}
+		return dynamic_cast<const Animal*>(e) != nullptr;
+	}
+	
+	static bool by_uid(const Organism *a, const Organism *b) {
+		return a->uid < b->uid;
+	}
+	
+	vec2 anchor(const Organism *e) const {
+		auto it = lists.find(e->uid);
+		return it != lists.end() ? it->second.anchor : e->pos;
+	}
+	
+	double disp(const List &l) const {
+		return length(l.owner->pos - l.anchor);
+	}
+	
+	// members whose anchor lies within the list radius around its anchor
+	void fill(List &l) {
+		l.items.clear();
+		chunks.query(l.anchor, l.radius + max_disp, [&](Organism *e) {
+			if(e != l.owner && length(anchor(e) - l.anchor) < l.radius) {
+				l.items.push_back(e);
+			}
+		});
+		std::sort(l.items.begin(), l.items.end(), by_uid);
+	}
+	
+	void account() {
+		size_t bytes = 0;
+		for(auto &p : lists) {
+			bytes += sizeof(List) + sizeof(Organism*)*p.second.items.capacity();
+		}
+		memory.set(bytes);
+	}
+	
+	template <typename F>
+	void rebuild(F reach) {
+		max_disp = 0.0;
+		max_radius = 0.0;
+		for(auto &p : lists) {
+			List &l = p.second;
+			l.anchor = l.owner->pos;
+			l.radius = reach(l.owner) + skin;
+			l.fresh = false;
+			if(Chunks::member(l.owner)) {
+				max_radius = std::max(max_radius, l.radius);
+			}
+		}
+		for(auto &p : lists) {
+			fill(p.second);
+		}
+		fresh.clear();
+		built = true;
+		rebuilds += 1;
+		account();
+	}
+	
+	// lists of the new owners, then the new members in the lists of the others
+	template <typename F>
+	void merge(F reach) {
+		for(Organism *e : fresh) {
+			auto it = lists.find(e->uid);
+			if(it != lists.end()) {
+				List &l = it->second;
+				l.radius = reach(e) + skin;
+				fill(l);
+				if(Chunks::member(e)) {
+					max_radius = std::max(max_radius, l.radius);
+				}
+			}
+		}
+		for(Organism *e : fresh) {
+			if(!Chunks::member(e)) {
+				continue;
+			}
+			vec2 x = anchor(e);
+			auto insert = [&](List &l) {
+				if(!l.fresh && l.owner != e && length(l.anchor - x) < l.radius) {
+					l.items.insert(std::upper_bound(l.items.begin(), l.items.end(), e, by_uid), e);
+				}
+			};
+			chunks.query(x, max_radius + max_disp, [&](Organism *o) {
+				auto it = lists.find(o->uid);
+				if(it != lists.end()) {
+					insert(it->second);
+				}
+			});
+			for(List *l : spawns) {
+				insert(*l);
+			}
+		}
+		for(Organism *e : fresh) {
+			auto it = lists.find(e->uid);
+			if(it != lists.end()) {
+				it->second.fresh = false;
+			}
+		}
+		fresh.clear();
+	}
+
+public:
+	// 0 turns the lists off, the contact phase then queries the chunks every step
+	double skin = 20.0;
+	long updates = 0, rebuilds = 0;
+	// owners whose reach outgrew their list within a step and queried the chunks instead
+	long fallbacks = 0;
+	
+	Neighbors(const Chunks &c) : chunks(c) {}
+	
+	// brings the lists up to the positions after the last move; `reach(e)` is the contact
+	// reach of owner `e` in this step
+	template <typename F>
+	void update(F reach) {
+		if(skin <= 0.0) {
+			return;
+		}
+		updates += 1;
+		if(!built) {
+			rebuild(reach);
+			return;
+		}
+		
+		max_disp = 0.0;
+		for(auto &p : lists) {
+			max_disp = std::max(max_disp, disp(p.second));
+		}
+		merge(reach);
+		
+		for(auto &p : lists) {
+			const List &l = p.second;
+			if(!covers(l, reach(l.owner))) {
+				rebuild(reach);
+				return;
+			}
+		}
+		account();
+	}
+	
+	// list of owner `e`, null if it has none
+	const List *find(const Organism *e) const {
+		if(skin <= 0.0) {
+			return nullptr;
+		}
+		auto it = lists.find(e->uid);
+		return it != lists.end() && !it->second.fresh ? &it->second : nullptr;
+	}
+	
+	// whether the list holds all organisms within `reach` of its owner
+	bool covers(const List &l, double reach) const {
+		return reach + disp(l) + max_disp + 1e-6 <= l.radius;
+	}
+	
+	// rebuilds per update, 1 when every step runs the broad phase
+	double rate() const {
+		return updates > 0 ? double(rebuilds)/updates : 0.0;
+	}
+	
+	// mean length of the lists
+	double mean() const {
+		size_t n = 0;
+		for(auto &p : lists) {
+			n += p.second.items.size();
+		}
+		return lists.empty() ? 0.0 : double(n)/lists.size();
+	}
+	
+	void added(Organism *e) override {
+		if(skin <= 0.0) {
+			return;
+		}
+		if(owner(e)) {
+			List &l = lists[e->uid];
+			l.owner = e;
+			l.anchor = e->pos;
+			if(dynamic_cast<Spawn*>(e) != nullptr) {
+				spawns.push_back(&l);
+			}
+		}
+		if(built) {
+			fresh.push_back(e);
+		}
+	}
+	
+	void died(Organism *e) override {
+		vec2 x = anchor(e);
+		auto it = lists.find(e->uid);
+		if(it != lists.end()) {
+			spawns.erase(std::remove(spawns.begin(), spawns.end(), &it->second), spawns.end());
+			lists.erase(it);
+		}
+		auto f = std::find(fresh.begin(), fresh.end(), e);
+		if(f != fresh.end()) {
+			fresh.erase(f);
+		} else if(built && Chunks::member(e)) {
+			auto erase = [&](List &l) {
+				auto i = std::lower_bound(l.items.begin(), l.items.end(), e, by_uid);
+				if(i != l.items.end() && *i == e) {
+					l.items.erase(i);
+				}
+			};
+			chunks.query(x, max_radius + max_disp, [&](Organism *o) {
+				auto it = lists.find(o->uid);
+				if(it != lists.end()) {
+					erase(it->second);
+				}
+			});
+			for(List *l : spawns) {
+				erase(*l);
+			}
+		}
+	}
+};
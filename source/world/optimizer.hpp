@@ -0,0 +1,28 @@
+#pragma once
+
+#include "mind.hpp"
+
+class Animal;
+
+// Source of the minds of spawned animals for one species, learning from the animals
+// that die. The world keeps its champion selector in any case, for snapshots, the
+// archive and the side panel.
+class Optimizer {
+public:
+	virtual ~Optimizer() {}
+	
+	// every animal of the species, when it dies
+	virtual void add(Animal *a) = 0;
+	// once per step, after the dead of the step were added
+	virtual void select() {}
+	
+	// mind a spawned animal is derived from, null for a random one
+	virtual const Mind *genMind() = 0;
+	// whether spawns mutate the minds returned by genMind()
+	virtual bool mutates() const {
+		return true;
+	}
+	
+	// current best estimate, null if there is none yet
+	virtual const Mind *best() const = 0;
+};
@@ -9,18 +9,57 @@
 #include "vector.hpp"
 #include "random.hpp"
 #include "mind.hpp"
+#include "listener.hpp"
+#include "real.hpp"
+
+#include <memory.hpp>
 
 #include <core/entity.hpp>
 
+enum Kind {
+	KIND_NONE = 0,
+	KIND_PLANT,
+	KIND_HERBIVORE,
+	KIND_CARNIVORE,
+	KIND_SPAWN_PLANT,
+	KIND_SPAWN_HERBIVORE,
+	KIND_SPAWN_CARNIVORE,
+	KIND_COUNT
+};
+
+struct Chunk;
+struct FieldCell;
+
 class Organism : public Entity {
 public:
-	double _score = 0.0;
+	// unique over the whole run, assigned by the world on add
+	long uid = -1;
+	Listener *listener = nullptr;
 	
-	double energy = 0.0;
+	// chunk of the world holding the organism and slot in it
+	Chunk *chunk = nullptr;
+	int chunk_slot = -1;
+	
+	// position at the start of the last move phase
+	vec2 prev = nullvec2;
+	
+	real _score = 0.0;
+	
+	real energy = 0.0;
 	bool alive = true;
 	
 	long total_age = 0;
 	int age = 0, anc = 0;
+	// age in steps of the reference length, organisms die of age by it; equals `age` with
+	// the fixed step
+	double aged = 0.0;
+	
+	// charged by the world that holds the organism
+	MemoryCharge memory = MemoryCharge(MEM_ORGANISMS);
+	
+	virtual Kind kind() const {
+		return KIND_NONE;
+	}
 	
 	virtual double size() const {
 		return 0.5*sqrt(energy);
@@ -30,19 +69,70 @@ public:
 		return _score;
 	}
 	
-	virtual void process() {
+	// `tick` is the length of the last move in reference steps, 1 with the fixed step;
+	// rates given per step are scaled by it
+	virtual void process(double tick) {
 		age += 1;
 		total_age += 1;
+		aged += tick;
 	}
 	
 	virtual std::list<Organism*> produce() {
 		return std::list<Organism*>();
 	}
+	
+	// closest distance between two organisms over the last move, assuming both moved linearly
+	static double approach(const Organism *a, const Organism *b) {
+		vec2 d = b->prev - a->prev;
+		vec2 v = (b->pos - b->prev) - (a->pos - a->prev);
+		double vv = v.x()*v.x() + v.y()*v.y();
+		double t = 1.0;
+		if(vv > 1e-12) {
+			t = -(d.x()*v.x() + d.y()*v.y())/vv;
+			t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+		}
+		return length(d + t*v);
+	}
 };
 
 struct PG {
+	// potential and unit gradient, set by finish()
 	double pot = 0.0;
 	vec2 grad = nullvec2;
+	
+	// running sums in state precision
+	Sum<real> sp, sx, sy;
+	
+	// source of size `s` at offset `d`, weighted by `m`
+	void add(const vec2 &d, double s, double m) {
+		real l = real(length(d) + s);
+		sp.add(real(m)/l);
+		sx.add(real(m)*real(d.x())/(l*l*l));
+		sy.add(real(m)*real(d.y())/(l*l*l));
+	}
+	
+	// aggregate of sources with potential `p` and gradient `g`
+	void add(double p, const vec2 &g) {
+		sp.add(real(p));
+		sx.add(real(g.x()));
+		sy.add(real(g.y()));
+	}
+	
+	void scale(double k) {
+		sp.scale(real(k));
+		sx.scale(real(k));
+		sy.scale(real(k));
+	}
+	
+	void finish() {
+		pot = sp.value();
+		grad = vec2(sx.value(), sy.value());
+		double lg = length(grad);
+		if(lg < 1e-8)
+			grad = nullvec2;
+		else
+			grad = normalize(grad);
+	}
 };
 
 class Plant : public Organism {
@@ -58,27 +148,85 @@ public:
 	
 	double max_score = lower_energy;
 	
+	// bookkeeping of the plant field cache: size accounted for, finest cell and slot in it
+	double field_size = 0.0;
+	FieldCell *field_cell = nullptr;
+	int field_slot = -1;
+	
+	// bookkeeping of the scheduler: step of the last process() before sleeping (-1 when awake),
+	// step to be woken at, slot in the timing wheel and size when put to sleep
+	long slept = -1, wake = -1;
+	int wheel_slot = -1;
+	double sleep_size = 0.0;
+	
 	Plant() {
 		max_score = lower_energy + (upper_energy - lower_energy)*rand_unif();
 	}
 	
+	Kind kind() const override {
+		return KIND_PLANT;
+	}
+	
 	virtual void interact(Entity *e) override {}
 	
-	void process() override {
-		Organism::process();
+	void process(double tick) override {
+		Organism::process(tick);
 		// die
-		if(energy <= 0.0 || age + score_fine*(energy - lower_energy) > max_age) {
+		if(energy <= 0.0 || aged + score_fine*(energy - lower_energy) > max_age) {
 			alive = false;
 			return;
 		}
 		// grow
 		if(energy < max_score) {
-			energy += grow_speed + grow_exp*energy;
+			energy += (grow_speed + grow_exp*energy)*tick;
 			if(energy > max_score) {
 				energy = max_score;
 			}
 		}
 	}
+	
+	// a saturated plant only ages until it dies or is eaten
+	bool saturated() const {
+		return energy >= max_score;
+	}
+	
+	// number of further process() calls a saturated plant survives, the last one kills it
+	long lifetime() const {
+		long k = long(floor(max_age - score_fine*(energy - lower_energy) - aged)) + 1;
+		return k < 1 ? 1 : k;
+	}
+	
+	// age as it would be after the process() calls skipped while sleeping up to `step`
+	long skipped(long step) const {
+		return slept < 0 ? 0 : step - slept - 1;
+	}
+	
+	void catch_up(long step) {
+		long k = skipped(step);
+		age += int(k);
+		aged += k;
+		total_age += k;
+		slept = -1;
+	}
+};
+
+// Sensor layout of the animals of a world, it defines the brain input size. Each world
+// has its own and hands it to the animals it creates, offspring take their parent's.
+// Every eye is a ray returning the nearest hit: closeness and species of the target.
+struct Sensors {
+	static const int channels = 3, eye_inputs = 4;
+	
+	int eyes = 0;
+	double fov = M_PI, range = 200.0;
+	
+	int inputs() const {
+		return 3*channels + eye_inputs*eyes;
+	}
+	
+	// direction of an eye relative to the heading
+	double angle(int eye) const {
+		return fov*((eye + 0.5)/eyes - 0.5);
+	}
 };
 
 class Animal : public Organism {
@@ -102,18 +250,27 @@ public:
 	vec2 dir = vec2(1, 0);
 	double spin = 0.0;
 	
-	// const int neyes = 12;
+	// eating tests the closest approach over the last move instead of the distance after
+	// it, set by the world when steps may be longer than the eating range
+	bool swept = false;
+	
+	// potential of the food sensed over the lifetime in reference steps, a dense measure of
+	// how close to food the animal kept for optimizers that score few animals; not saved
+	double foraged = 0.0;
+	
+	const Sensors sensors;
 	const int 
-		ni = 3*3,
+		ni = sensors.inputs(),
 		no = 2,
 		nh = 16;
 	
 	Mind mind;
-	slice<float> Wih, Whh, bh, Who, bo;
+	slice<const float> Wih, Whh, bh, Who, bo;
 	slice<float> vi, vo, vh;
 	vector<float> th;
 	
-	Animal(const Mind *esrc = nullptr) : 
+	Animal(const Sensors &s, const Mind *esrc = nullptr) : 
+		sensors(s),
 		mind(ni, no, ni*nh + (nh*nh + nh) + nh*no + no, nh),
 		th(nh)
 	{
@@ -129,26 +286,29 @@ public:
 			mind = *esrc;
 		}
 		
-		float *w = mind.weight.data();
+		vi = slice<float>(mind.input.data(), ni);
+		vo = slice<float>(mind.output.data(), no);
+		vh = slice<float>(mind.memory.data(), nh);
+	}
+	
+	// weights live in the shared genome which is replaced on mutation, so views are rebound before use
+	void bind() {
+		const float *w = mind.weight();
 		
-		Wih = slice<float>(w, ni*nh);
+		Wih = slice<const float>(w, ni*nh);
 		w += Wih.size();
 		
-		Whh = slice<float>(w, nh*nh);
+		Whh = slice<const float>(w, nh*nh);
 		w += Whh.size();
 		
-		bh = slice<float>(w, nh);
+		bh = slice<const float>(w, nh);
 		w += bh.size();
 		
-		Who = slice<float>(w, nh*no);
+		Who = slice<const float>(w, nh*no);
 		w += Who.size();
 		
-		bo = slice<float>(w, no);
+		bo = slice<const float>(w, no);
 		w += bo.size();
-		
-		vi = slice<float>(mind.input.data(), ni);
-		vo = slice<float>(mind.output.data(), no);
-		vh = slice<float>(mind.memory.data(), nh);
 	}
 	
 	double score() const override {
@@ -156,16 +316,21 @@ public:
 	}
 	
 	virtual bool edible(const Organism *e) const = 0;
+	// sense channel of the food: 0 plants, 1 herbivores
+	virtual int food() const = 0;
 	
 	void interact(Entity *e) override {
 		// eat
 		Organism *o = static_cast<Organism*>(e);
 		if(edible(o)) {
-			if(o->alive && length(o->pos - pos) < 0.8*(o->size() + size())) {
-				double ae = o->energy*eat_factor;
+			if(o->alive && (swept ? approach(this, o) : length(o->pos - pos)) < 0.8*(o->size() + size())) {
+				double oe = o->energy, ae = oe*eat_factor;
 				energy += ae;
 				o->energy = 0.0;
 				_score += ae;
+				if(listener != nullptr) {
+					listener->ate(this, o, oe);
+				}
 			}
 		}
 	}
@@ -183,20 +348,31 @@ public:
 		}
 	}
 	
-	void process() override {
-		Organism::process();
+	// hit of an eye ray, `e` is null if nothing is in range
+	void see(int eye, const Organism *e, double dist) {
+		float *in = mind.input.data() + 3*Sensors::channels + Sensors::eye_inputs*eye;
+		in[0] = e != nullptr ? float(1.0 - dist/sensors.range) : 0.0f;
+		in[1] = e != nullptr && e->kind() == KIND_PLANT;
+		in[2] = e != nullptr && e->kind() == KIND_HERBIVORE;
+		in[3] = e != nullptr && e->kind() == KIND_CARNIVORE;
+	}
+	
+	void process(double tick) override {
+		Organism::process(tick);
 		
 		// update scores
-		energy -= time_fine + spin_fine*fabs(spin);
+		energy -= (time_fine + spin_fine*fabs(spin))*tick;
 		
 		// check able to live
-		if(energy < 0.0 || age > max_age) {
+		if(energy < 0.0 || aged > max_age) {
 			// die
 			alive = false;
 			return;
 		}
+		foraged += tick*mind.input[3*food() + 2];
 		
 		// mind step
+		bind();
 		dot(th, Wih, vi);
 		dot(vh, Whh, vh);
 		add(vh, th, vh);
@@ -222,16 +398,17 @@ public:
 				
 				anim->energy = energy/child_count;
 				anim->total_age = total_age;
-				anim->anc = (anc += 1);
+				anim->anc = anc + 1;
 				
 				anim->pos = pos + 0.5*rand_disk()*size();
 				
-				anim->mind.vary(rand_norm, mind_delta);
+				anim->mind.vary(unsigned(rand_int()), mind_delta);
+				anim->mind.origin = uid;
 				
 				list.push_back(anim);
 			}
 			
-			_score += breed_factor*(max_age - age);
+			_score += breed_factor*(max_age - aged);
 			alive = false;
 		}
 		
@@ -244,12 +421,14 @@ public:
 		double sda = sin(da), cda = cos(da);
 		mat2 rot(cda, sda, -sda, cda);
 		dir = normalize(rot*dir);
+		// follow the heading when the move phase is split into substeps
+		vel = rot*vel;
 	}
 };
 
 class Herbivore : public Animal {
 public:
-	Herbivore(const Mind *ms = nullptr) : Animal(ms) {
+	Herbivore(const Sensors &s, const Mind *ms = nullptr) : Animal(s, ms) {
 		max_speed = 100.0;
 		
 		max_age = 500;
@@ -260,12 +439,20 @@ public:
 		breed_energy = 800.0;
 	}
 	
+	Kind kind() const override {
+		return KIND_HERBIVORE;
+	}
+	
 	bool edible(const Organism *e) const override {
 		return dynamic_cast<const Plant*>(e) != nullptr;
 	}
 	
+	int food() const override {
+		return 0;
+	}
+	
 	Herbivore *instance() const override {
-		return new Herbivore(&mind);
+		return new Herbivore(sensors, &mind);
 	}
 };
 
@@ -273,7 +460,7 @@ class Carnivore : public Animal {
 public:
 	double eat_energy = 0.2;
 	
-	Carnivore(const Mind *ms = nullptr) : Animal(ms) {
+	Carnivore(const Sensors &s, const Mind *ms = nullptr) : Animal(s, ms) {
 		max_speed = 100.0;
 		
 		max_age = 1000;
@@ -284,6 +471,10 @@ public:
 		breed_energy = 1000.0;
 	}
 	
+	Kind kind() const override {
+		return KIND_CARNIVORE;
+	}
+	
 	bool edible(const Organism *e) const override {
 		auto h = dynamic_cast<const Herbivore*>(e);
 		if(h == nullptr)
@@ -293,7 +484,11 @@ public:
 		return true;
 	}
 	
+	int food() const override {
+		return 1;
+	}
+	
 	Carnivore *instance() const override {
-		return new Carnivore(&mind);
+		return new Carnivore(sensors, &mind);
 	}
 };
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <trace.hpp>
+
+#include "organism.hpp"
+
+// Persistent threads running one job per step phase; worker `k` always gets the same
+// index, so data owned by index `k` stays in the caches of one core. The calling
+// thread is worker 0.
+class Workers {
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable cond, done;
+	std::function<void(int)> job;
+	long generation = 0;
+	int remaining = 0;
+	bool stop = false;
+	
+	void loop(int id) {
+		Trace::get().name("step worker");
+		long seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			cond.wait(lock, [&](){return stop || generation != seen;});
+			if(stop) {
+				return;
+			}
+			seen = generation;
+			lock.unlock();
+			job(id);
+			lock.lock();
+			if(--remaining == 0) {
+				done.notify_all();
+			}
+		}
+	}
+
+public:
+	Workers(int n = 1) {
+		for(int i = 1; i < n; ++i) {
+			threads.push_back(std::thread([this, i](){loop(i);}));
+		}
+	}
+	
+	~Workers() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+			cond.notify_all();
+		}
+		for(std::thread &t : threads) {
+			t.join();
+		}
+	}
+	
+	int size() const {
+		return int(threads.size()) + 1;
+	}
+	
+	// runs `f(k)` for every worker and returns when all are done
+	void run(const std::function<void(int)> &f) {
+		if(threads.empty()) {
+			f(0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = f;
+			remaining = int(threads.size());
+			generation += 1;
+			cond.notify_all();
+		}
+		f(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this](){return remaining == 0;});
+	}
+};
+
+// Animal as seen by the sensing of other animals, packed for sequential reads
+struct Body {
+	long uid;
+	Kind kind;
+	vec2 pos;
+	double size;
+};
+
+// Parallel loop over the animals for the phases that read the shared world and write only
+// the animal itself: sensing, eye rays and moves. The animals are split in uid order into
+// one contiguous share per worker. This is not a domain decomposition, contacts, process
+// and reproduction stay on the step thread, so results do not depend on the number of
+// workers. The animals read by sensing are packed once per step, at the barrier before
+// the phase, in uid order, so every share sums them in the same order as a single thread.
+class Parallel {
+private:
+	Workers workers;
+	std::vector<Animal*> list;
+
+public:
+	std::vector<Body> bodies;
+	
+	Parallel(int n = 1) : workers(n) {}
+	
+	int size() const {
+		return workers.size();
+	}
+	
+	// packs the animals for sensing, `animals` is in uid order
+	void exchange(const std::map<long, Animal*> &animals) {
+		bodies.resize(animals.size());
+		size_t i = 0;
+		for(auto &p : animals) {
+			const Animal *a = p.second;
+			bodies[i++] = Body{a->uid, a->kind(), a->pos, a->size()};
+		}
+	}
+	
+	// runs `f` for every animal, share by share in parallel
+	void each(const std::map<long, Animal*> &animals, const std::function<void(Animal*)> &f) {
+		list.clear();
+		for(auto &p : animals) {
+			list.push_back(p.second);
+		}
+		int n = workers.size();
+		workers.run([this, &f, n](int k) {
+			TraceSpan ts("share");
+			size_t i0 = list.size()*k/n, i1 = list.size()*(k + 1)/n;
+			for(size_t i = i0; i < i1; ++i) {
+				f(list[i]);
+			}
+		});
+	}
+};
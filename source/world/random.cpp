@@ -1,12 +1,32 @@
 #include "random.hpp"
 
 #include <random>
+#include <sstream>
 #include <cmath>
 
-static std::minstd_rand rand_engine;
-static std::uniform_int_distribution<> int_dist;
-static std::uniform_real_distribution<> unif_dist;
-static std::normal_distribution<> norm_dist;
+// one generator per thread, so that worlds stepped on different threads do not share a sequence
+static thread_local std::minstd_rand rand_engine;
+static thread_local std::uniform_int_distribution<> int_dist;
+static thread_local std::uniform_real_distribution<> unif_dist;
+static thread_local std::normal_distribution<> norm_dist;
+
+void rand_seed(unsigned seed) {
+	rand_engine.seed(seed);
+	int_dist.reset();
+	unif_dist.reset();
+	norm_dist.reset();
+}
+
+std::string rand_state() {
+	std::stringstream ss;
+	ss << rand_engine << ' ' << int_dist << ' ' << unif_dist << ' ' << norm_dist;
+	return ss.str();
+}
+
+void rand_restore(const std::string &state) {
+	std::stringstream ss(state);
+	ss >> rand_engine >> int_dist >> unif_dist >> norm_dist;
+}
 
 int rand_int() {
 	return int_dist(rand_engine);
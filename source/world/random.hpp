@@ -1,7 +1,13 @@
 #pragma once
 
+#include <string>
+
 #include <la/vec.hpp>
 
+void rand_seed(unsigned seed);
+std::string rand_state();
+void rand_restore(const std::string &state);
+
 int rand_int();
 double rand_unif();
 double rand_norm();
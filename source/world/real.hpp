@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cmath>
+
+#include <la/vec.hpp>
+
+// Precision of the simulation state, chosen at build time: define NEVO_FLOAT_STATE for
+// single precision. Positions and velocities belong to the framework entity and stay
+// vec2, in float mode they are rounded to float after every move.
+//
+// Float mode emulates a single precision state to check that the dynamics survive it;
+// it is not a performance mode. Nothing is stored smaller or vectorized by it, and the
+// rounding and compensated sums make it slower than the double build.
+#ifdef NEVO_FLOAT_STATE
+typedef float real;
+#else
+typedef double real;
+#endif
+
+inline const char *real_name() {
+	return sizeof(real) == sizeof(float) ? "float" : "double";
+}
+
+// rounds to the precision of the state
+inline vec2 snap(const vec2 &v) {
+	return vec2(real(v.x()), real(v.y()));
+}
+
+// Kahan-compensated running sum, so that adding many small terms to a large one does not
+// lose them in single precision. An infinite sum drops the compensation, inf - inf would
+// turn it and then the sum into NaN where the plain sum stays infinite.
+template <typename T>
+struct Sum {
+	T s = T(0), c = T(0);
+	
+	void add(T x) {
+		T y = x - c;
+		T t = s + y;
+		c = std::isfinite(t) ? (t - s) - y : T(0);
+		s = t;
+	}
+	
+	void scale(T k) {
+		s *= k;
+		c *= k;
+	}
+	
+	T value() const {
+		return s;
+	}
+};
+
+// in double precision the plain sum is accurate enough and keeps results unchanged
+template <>
+struct Sum<double> {
+	double s = 0.0;
+	
+	void add(double x) {
+		s += x;
+	}
+	
+	void scale(double k) {
+		s *= k;
+	}
+	
+	double value() const {
+		return s;
+	}
+};
@@ -0,0 +1,542 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include <memory.hpp>
+#include <varint.hpp>
+#include <writer.hpp>
+
+#include "myworld.hpp"
+#include "listener.hpp"
+
+static const char RECORD_MAGIC[8] = {'N', 'E', 'V', 'O', 'R', 'E', 'C', '1'};
+static const char RECORD_INDEX_MAGIC[8] = {'N', 'E', 'V', 'O', 'R', 'I', 'X', '1'};
+
+// columns of a chunk in file order
+enum RecordColumn {
+	// per organism: uid gap, kind and row count
+	RECORD_IDS = 0,
+	// per row: step gap to the previous row of the organism
+	RECORD_STEP,
+	RECORD_X,
+	RECORD_Y,
+	// heading angle
+	RECORD_DIR,
+	RECORD_ENERGY,
+	// brain outputs: speed and turn
+	RECORD_OUT0,
+	RECORD_OUT1,
+	RECORD_EVENTS,
+	RECORD_COLUMNS
+};
+
+// float columns, RECORD_X onwards
+static const int RECORD_FIELDS = RECORD_OUT1 - RECORD_X + 1;
+
+enum RecordEventType {
+	RECORD_BORN = 1,
+	RECORD_DIED,
+	RECORD_ATE
+};
+
+struct RecordHeader {
+	char magic[8];
+	uint32_t version = 1;
+	uint32_t period = 1;
+	double width = 0.0, height = 0.0;
+};
+
+// Written as raw bytes, so the fields fill the struct with no padding: 72 bytes.
+struct RecordChunkHeader {
+	// steps covered, inclusive
+	int64_t first = 0, last = 0;
+	uint32_t rows = 0, organisms = 0, events = 0;
+	uint32_t reserved[2] = {0, 0};
+	// encoded size of each column
+	uint32_t size[RECORD_COLUMNS] = {0};
+};
+
+struct RecordIndexEntry {
+	int64_t offset = 0;
+	int64_t first = 0, last = 0;
+	int64_t min_uid = -1, max_uid = -1;
+	uint32_t rows = 0, events = 0;
+};
+
+struct RecordEvent {
+	int64_t step;
+	long uid, other;
+	uint8_t type;
+	// energy taken by a meal
+	float energy;
+};
+
+// Rows of a range of steps. The recorder fills it in step order, the reader returns it
+// by organism: all rows of one uid are adjacent and in step order.
+struct RecordChunk {
+	int64_t first = -1, last = -1;
+	std::vector<long> uid;
+	std::vector<uint8_t> kind;
+	std::vector<int64_t> step;
+	std::vector<float> field[RECORD_FIELDS];
+	std::vector<RecordEvent> events;
+	
+	size_t rows() const {
+		return uid.size();
+	}
+	
+	bool empty() const {
+		return uid.empty() && events.empty();
+	}
+	
+	size_t footprint() const {
+		size_t b = uid.capacity()*sizeof(long) + kind.capacity() + step.capacity()*sizeof(int64_t);
+		for(const std::vector<float> &f : field) {
+			b += f.capacity()*sizeof(float);
+		}
+		return b + events.capacity()*sizeof(RecordEvent);
+	}
+	
+	void clear() {
+		first = last = -1;
+		uid.clear();
+		kind.clear();
+		step.clear();
+		for(std::vector<float> &f : field) {
+			f.clear();
+		}
+		events.clear();
+	}
+	
+	const float &value(RecordColumn c, size_t row) const {
+		return field[c - RECORD_X][row];
+	}
+};
+
+// Integer coding of the columns: varints, zigzag for signed gaps, and float bit patterns
+// as gaps to the previous value of the same organism, which are small for smooth values.
+// There is no entropy coding stage, the varint gaps are all the compression there is.
+struct RecordCoding {
+	static uint32_t bits(float f) {
+		uint32_t b;
+		memcpy(&b, &f, sizeof(b));
+		return b;
+	}
+	static float value(uint32_t b) {
+		float f;
+		memcpy(&f, &b, sizeof(f));
+		return f;
+	}
+	static uint64_t delta(float v, float prev) {
+		return Varint::zigzag(int32_t(bits(v) - bits(prev)));
+	}
+	static float undelta(uint64_t d, float prev) {
+		return value(uint32_t(bits(prev) + uint32_t(int32_t(Varint::unzigzag(d)))));
+	}
+};
+
+// Records animal trajectories (position, heading, energy and brain outputs) and their
+// births, deaths and meals in columnar chunks of `chunk_steps` steps. The step thread
+// appends raw rows and encodes a chunk once it is full; the encoded chunk is handed to
+// the writer thread without copying, so the step thread only waits when the disk falls
+// behind. The chunk index by step range goes at the end of the file.
+class Recorder : public Listener {
+private:
+	const MyWorld &world;
+	AsyncWriter writer;
+	bool closed = false, closed_ok = false;
+	
+	RecordChunk front;
+	
+	// the raw chunk and the encoding buffers, the chunk in flight is charged by the writer
+	MemoryCharge memory = MemoryCharge(MEM_RECORDERS);
+	
+	int64_t offset = 0;
+	std::vector<RecordIndexEntry> index;
+	std::vector<char> columns[RECORD_COLUMNS];
+	std::vector<size_t> order;
+	
+	void encode(const RecordChunk &c, RecordChunkHeader &h) {
+		for(std::vector<char> &col : columns) {
+			col.clear();
+		}
+		order.resize(c.rows());
+		for(size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		// rows come in step order with uids sorted within a step
+		std::stable_sort(order.begin(), order.end(), [&c](size_t a, size_t b) {return c.uid[a] < c.uid[b];});
+		
+		h.first = c.first;
+		h.last = c.last;
+		h.rows = uint32_t(c.rows());
+		long last_uid = -1;
+		int64_t prev_step = 0;
+		float prev[RECORD_FIELDS];
+		for(size_t k = 0; k < order.size(); ++k) {
+			size_t r = order[k];
+			if(k == 0 || c.uid[r] != last_uid) {
+				size_t n = k;
+				while(n < order.size() && c.uid[order[n]] == c.uid[r]) {
+					++n;
+				}
+				Varint::put(columns[RECORD_IDS], uint64_t(c.uid[r] - last_uid));
+				columns[RECORD_IDS].push_back(char(c.kind[r]));
+				Varint::put(columns[RECORD_IDS], n - k);
+				h.organisms += 1;
+				last_uid = c.uid[r];
+				prev_step = c.first;
+				for(float &p : prev) {
+					p = 0.0f;
+				}
+			}
+			Varint::put(columns[RECORD_STEP], uint64_t(c.step[r] - prev_step));
+			prev_step = c.step[r];
+			for(int f = 0; f < RECORD_FIELDS; ++f) {
+				float v = c.field[f][r];
+				Varint::put(columns[RECORD_X + f], RecordCoding::delta(v, prev[f]));
+				prev[f] = v;
+			}
+		}
+		
+		h.events = uint32_t(c.events.size());
+		std::vector<char> &ev = columns[RECORD_EVENTS];
+		prev_step = c.first;
+		long prev_uid = 0;
+		for(const RecordEvent &e : c.events) {
+			Varint::put(ev, uint64_t(e.step - prev_step));
+			ev.push_back(char(e.type));
+			Varint::put(ev, Varint::zigzag(e.uid - prev_uid));
+			Varint::put(ev, Varint::zigzag(e.other - e.uid));
+			if(e.type == RECORD_ATE) {
+				uint32_t b = RecordCoding::bits(e.energy);
+				ev.insert(ev.end(), reinterpret_cast<const char*>(&b), reinterpret_cast<const char*>(&b) + sizeof(b));
+			}
+			prev_step = e.step;
+			prev_uid = e.uid;
+		}
+		
+		for(int i = 0; i < RECORD_COLUMNS; ++i) {
+			h.size[i] = uint32_t(columns[i].size());
+		}
+	}
+	
+	void store(const RecordChunk &c) {
+		RecordChunkHeader h;
+		encode(c, h);
+		RecordIndexEntry ie;
+		ie.offset = offset;
+		ie.first = h.first;
+		ie.last = h.last;
+		ie.rows = h.rows;
+		ie.events = h.events;
+		if(!c.uid.empty()) {
+			auto mm = std::minmax_element(c.uid.begin(), c.uid.end());
+			ie.min_uid = *mm.first;
+			ie.max_uid = *mm.second;
+		}
+		index.push_back(ie);
+		
+		std::vector<char> block(reinterpret_cast<const char*>(&h), reinterpret_cast<const char*>(&h) + sizeof(h));
+		for(const std::vector<char> &col : columns) {
+			block.insert(block.end(), col.begin(), col.end());
+		}
+		offset += block.size();
+		bytes = offset;
+		writer.write(std::move(block));
+	}
+	
+	void account() {
+		size_t b = front.footprint() + order.capacity()*sizeof(size_t);
+		for(const std::vector<char> &col : columns) {
+			b += col.capacity();
+		}
+		memory.set(b);
+	}
+	
+	void swap() {
+		if(front.empty()) {
+			front.clear();
+			return;
+		}
+		store(front);
+		front.clear();
+		if(Memory::get().over(MEM_RECORDERS)) {
+			// give up the capacity of the old chunk, steps are dropped until it fits again
+			front = RecordChunk();
+		}
+	}
+	
+	void event(uint8_t type, long uid, long other, double energy = 0.0) {
+		if(front.first < 0) {
+			front.first = world.step_index;
+		}
+		front.events.push_back(RecordEvent{world.step_index, uid, other, type, float(energy)});
+	}
+
+public:
+	// every n-th step is recorded
+	long period = 1;
+	// share of organisms recorded, picked by a hash of the uid so that an organism is
+	// recorded over its whole life or not at all
+	double fraction = 1.0;
+	// if not empty, only these uids are recorded
+	std::set<long> ids;
+	long chunk_steps = 1000;
+	
+	// recorded steps skipped because recorders were over their memory budget
+	long dropped = 0;
+	// bytes handed to the writer so far
+	std::atomic<int64_t> bytes;
+	
+	Recorder(const MyWorld &w, const char *path, long p = 1, double f = 1.0) : world(w), writer(path), bytes(0) {
+		period = p > 0 ? p : 1;
+		fraction = f;
+		RecordHeader h;
+		memcpy(h.magic, RECORD_MAGIC, sizeof(h.magic));
+		h.period = uint32_t(period);
+		h.width = world.size.x();
+		h.height = world.size.y();
+		writer.write(&h, sizeof(h));
+		offset = sizeof(h);
+	}
+	
+	~Recorder() {
+		close();
+	}
+	
+	bool good() const {
+		return writer.good();
+	}
+	
+	// times the step thread waited for the writer
+	long stalls() const {
+		return writer.stalls;
+	}
+	
+	// writes the last chunk and the index, false if any write failed
+	bool close() {
+		if(!closed) {
+			closed = true;
+			swap();
+			uint64_t count = index.size();
+			writer.write(index.data(), sizeof(RecordIndexEntry)*index.size());
+			writer.write(&count, sizeof(count));
+			writer.write(RECORD_INDEX_MAGIC, sizeof(RECORD_INDEX_MAGIC));
+			closed_ok = writer.close();
+		}
+		return closed_ok;
+	}
+	
+	bool sampled(long uid) const {
+		if(!ids.empty()) {
+			return ids.count(uid) > 0;
+		}
+		if(fraction >= 1.0) {
+			return true;
+		}
+		uint64_t h = uint64_t(uid)*0x9e3779b97f4a7c15ull;
+		return double(h >> 11)*(1.0/9007199254740992.0) < fraction;
+	}
+	
+	void born(Organism *e, Organism *parent) override {
+		if(e->kind() != KIND_PLANT && e->kind() < KIND_SPAWN_PLANT && sampled(e->uid)) {
+			event(RECORD_BORN, e->uid, parent->uid);
+		}
+	}
+	
+	void died(Organism *e) override {
+		if(e->kind() != KIND_PLANT && e->kind() < KIND_SPAWN_PLANT && sampled(e->uid)) {
+			event(RECORD_DIED, e->uid, -1);
+		}
+	}
+	
+	void ate(Animal *e, Organism *food, double energy) override {
+		if(sampled(e->uid)) {
+			event(RECORD_ATE, e->uid, food->uid, energy);
+		}
+	}
+	
+	void stepped(long step) override {
+		if(closed || !writer.good()) {
+			return;
+		}
+		if(front.first < 0) {
+			front.first = step;
+		}
+		if(step % period == 0 && Memory::get().over(MEM_RECORDERS)) {
+			dropped += 1;
+		} else if(step % period == 0) {
+			for(auto &p : world.animals) {
+				const Animal *a = p.second;
+				if(!sampled(a->uid)) {
+					continue;
+				}
+				front.uid.push_back(a->uid);
+				front.kind.push_back(uint8_t(a->kind()));
+				front.step.push_back(step);
+				front.field[RECORD_X - RECORD_X].push_back(float(a->pos.x()));
+				front.field[RECORD_Y - RECORD_X].push_back(float(a->pos.y()));
+				front.field[RECORD_DIR - RECORD_X].push_back(float(atan2(a->dir.y(), a->dir.x())));
+				front.field[RECORD_ENERGY - RECORD_X].push_back(float(a->energy));
+				front.field[RECORD_OUT0 - RECORD_X].push_back(a->mind.output[0]);
+				front.field[RECORD_OUT1 - RECORD_X].push_back(a->mind.output[1]);
+			}
+		}
+		front.last = step;
+		if(step - front.first + 1 >= chunk_steps) {
+			swap();
+		}
+		account();
+	}
+};
+
+// Random access to a recording: chunks are found by step through the index at the end
+// of the file and decoded whole.
+class RecordReader {
+private:
+	FILE *file = nullptr;
+	std::vector<char> data;
+
+public:
+	RecordHeader header;
+	std::vector<RecordIndexEntry> index;
+	
+	RecordReader(const char *path) {
+		file = fopen(path, "rb");
+		if(file == nullptr) {
+			return;
+		}
+		uint64_t count = 0;
+		char magic[sizeof(RECORD_INDEX_MAGIC)];
+		bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) == 0 &&
+			fseek(file, -long(sizeof(count) + sizeof(magic)), SEEK_END) == 0 &&
+			fread(&count, sizeof(count), 1, file) == 1 && fread(magic, sizeof(magic), 1, file) == 1 &&
+			memcmp(magic, RECORD_INDEX_MAGIC, sizeof(magic)) == 0;
+		if(ok) {
+			index.resize(count);
+			long at = -long(sizeof(count) + sizeof(magic) + count*sizeof(RecordIndexEntry));
+			ok = fseek(file, at, SEEK_END) == 0 && fread(index.data(), sizeof(RecordIndexEntry), count, file) == count;
+		}
+		if(!ok) {
+			fclose(file);
+			file = nullptr;
+			index.clear();
+		}
+	}
+	
+	~RecordReader() {
+		if(file != nullptr) {
+			fclose(file);
+		}
+	}
+	
+	bool good() const {
+		return file != nullptr;
+	}
+	
+	// chunk holding `step`, -1 if not recorded
+	int find(long step) const {
+		auto it = std::upper_bound(index.begin(), index.end(), int64_t(step), [](int64_t s, const RecordIndexEntry &e) {return s < e.first;});
+		if(it == index.begin() || step > (it - 1)->last) {
+			return -1;
+		}
+		return int(it - index.begin()) - 1;
+	}
+	
+	bool load(int i, RecordChunk &c) {
+		c.clear();
+		RecordChunkHeader h;
+		if(file == nullptr || i < 0 || i >= int(index.size()) ||
+			fseek(file, long(index[i].offset), SEEK_SET) != 0 || fread(&h, sizeof(h), 1, file) != 1) {
+			return false;
+		}
+		const char *col[RECORD_COLUMNS], *end[RECORD_COLUMNS];
+		size_t total = 0;
+		for(uint32_t s : h.size) {
+			total += s;
+		}
+		data.resize(total);
+		if(fread(data.data(), 1, total, file) != total) {
+			return false;
+		}
+		size_t at = 0;
+		for(int k = 0; k < RECORD_COLUMNS; ++k) {
+			col[k] = data.data() + at;
+			at += h.size[k];
+			end[k] = data.data() + at;
+		}
+		
+		c.first = h.first;
+		c.last = h.last;
+		long uid = -1;
+		uint64_t v = 0;
+		for(uint32_t o = 0; o < h.organisms; ++o) {
+			uint64_t n = 0;
+			if(!Varint::get(col[RECORD_IDS], end[RECORD_IDS], v) || col[RECORD_IDS] >= end[RECORD_IDS]) {
+				return false;
+			}
+			uid += long(v);
+			uint8_t kind = uint8_t(*col[RECORD_IDS]++);
+			if(!Varint::get(col[RECORD_IDS], end[RECORD_IDS], n)) {
+				return false;
+			}
+			int64_t step = h.first;
+			float prev[RECORD_FIELDS] = {0.0f};
+			for(uint64_t r = 0; r < n; ++r) {
+				if(!Varint::get(col[RECORD_STEP], end[RECORD_STEP], v)) {
+					return false;
+				}
+				step += int64_t(v);
+				c.uid.push_back(uid);
+				c.kind.push_back(kind);
+				c.step.push_back(step);
+				for(int f = 0; f < RECORD_FIELDS; ++f) {
+					if(!Varint::get(col[RECORD_X + f], end[RECORD_X + f], v)) {
+						return false;
+					}
+					prev[f] = RecordCoding::undelta(v, prev[f]);
+					c.field[f].push_back(prev[f]);
+				}
+			}
+		}
+		
+		const char *&p = col[RECORD_EVENTS], *pe = end[RECORD_EVENTS];
+		int64_t step = h.first;
+		long prev_uid = 0;
+		for(uint32_t k = 0; k < h.events; ++k) {
+			RecordEvent e;
+			uint64_t u = 0, o = 0;
+			if(!Varint::get(p, pe, v) || p >= pe) {
+				return false;
+			}
+			e.step = step += int64_t(v);
+			e.type = uint8_t(*p++);
+			if(!Varint::get(p, pe, u) || !Varint::get(p, pe, o)) {
+				return false;
+			}
+			e.uid = prev_uid = prev_uid + long(Varint::unzigzag(u));
+			e.other = e.uid + long(Varint::unzigzag(o));
+			e.energy = 0.0f;
+			if(e.type == RECORD_ATE) {
+				uint32_t b;
+				if(p + sizeof(b) > pe) {
+					return false;
+				}
+				memcpy(&b, p, sizeof(b));
+				p += sizeof(b);
+				e.energy = RecordCoding::value(b);
+			}
+			c.events.push_back(e);
+		}
+		return true;
+	}
+};
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+
+#include <writer.hpp>
+#include <varint.hpp>
+
+#include "myworld.hpp"
+#include "listener.hpp"
+#include "snapshot.hpp"
+
+// Start of a log after the magic: what the world is built from before a keyframe is
+// restored. It has no padding, so it is written as it is.
+struct ReplayHeader {
+	uint32_t seed = 0;
+	// eye count of the sensors, it sets the shape of the minds
+	uint32_t eyes = 0;
+	// half extents of the world
+	double width = 0.0, height = 0.0;
+};
+
+// Log entry. Records are written as a type byte and varints, the step and uid as
+// differences to a base: the record before, or the keyframe before for the first record
+// after it. A birth takes at most 37 bytes and in practice 7 to 13, a death 4 or 5. A
+// keyframe record is followed by the byte count and the bytes of its snapshot.
+struct ReplayRecord {
+	enum Type {
+		SPAWN = 1,
+		BIRTH,
+		DEATH,
+		KEYFRAME
+	};
+	
+	uint8_t type = 0;
+	uint8_t kind = 0;
+	uint32_t seed = 0;
+	int64_t step = 0;
+	int64_t uid = 0;
+	int64_t parent = -1;
+	
+	ReplayRecord() {}
+	ReplayRecord(uint8_t t, long s) : type(t), step(s) {}
+	
+	static ReplayRecord birth(long step, const Organism *e, const Organism *parent) {
+		bool spawned = dynamic_cast<const Spawn*>(parent) != nullptr;
+		ReplayRecord r(spawned ? SPAWN : BIRTH, step);
+		r.kind = uint8_t(e->kind());
+		r.uid = e->uid;
+		r.parent = parent->uid;
+		if(auto a = dynamic_cast<const Animal*>(e)) {
+			r.seed = a->mind.genome->seed;
+		}
+		return r;
+	}
+	
+	static ReplayRecord death(long step, const Organism *e) {
+		ReplayRecord r(DEATH, step);
+		r.kind = uint8_t(e->kind());
+		r.uid = e->uid;
+		return r;
+	}
+	
+	// the base of the records after a keyframe at `step`
+	static ReplayRecord base(long step) {
+		return ReplayRecord(KEYFRAME, step);
+	}
+	
+	bool operator ==(const ReplayRecord &r) const {
+		return type == r.type && kind == r.kind && seed == r.seed && step == r.step && uid == r.uid && parent == r.parent;
+	}
+	
+	void encode(std::vector<char> &out, const ReplayRecord &base) const {
+		out.push_back(char(type));
+		Varint::put(out, uint64_t(step - base.step));
+		if(type == KEYFRAME) {
+			return;
+		}
+		out.push_back(char(kind));
+		Varint::put(out, Varint::zigzag(uid - base.uid));
+		if(type != DEATH) {
+			Varint::put(out, Varint::zigzag(uid - parent));
+			Varint::put(out, seed);
+		}
+	}
+	
+	// false at the end of the log or on a malformed record; a keyframe leaves its byte
+	// count and snapshot unread
+	bool decode(FILE *f, const ReplayRecord &base) {
+		int t = fgetc(f);
+		uint64_t v = 0;
+		if(t < SPAWN || t > KEYFRAME || !read(f, v)) {
+			return false;
+		}
+		*this = ReplayRecord(uint8_t(t), base.step + int64_t(v));
+		if(type == KEYFRAME) {
+			return true;
+		}
+		int k = fgetc(f);
+		if(k == EOF || !read(f, v)) {
+			return false;
+		}
+		kind = uint8_t(k);
+		uid = base.uid + Varint::unzigzag(v);
+		if(type != DEATH) {
+			if(!read(f, v)) {
+				return false;
+			}
+			parent = uid - Varint::unzigzag(v);
+			if(!read(f, v)) {
+				return false;
+			}
+			seed = uint32_t(v);
+		}
+		return true;
+	}
+	
+	// varint from a file
+	static bool read(FILE *f, uint64_t &v) {
+		v = 0;
+		for(int s = 0; s < 64; s += 7) {
+			int c = fgetc(f);
+			if(c == EOF) {
+				return false;
+			}
+			v |= uint64_t(c & 0x7f) << s;
+			if(!(c & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+static const char REPLAY_MAGIC[8] = {'N', 'E', 'V', 'O', 'L', 'O', 'G', '6'};
+
+// Append-only event log: header, spawns, births (parent and mutation seed), deaths
+// and periodic keyframes. Records are buffered and written by a background thread.
+class ReplayLog : public Listener {
+private:
+	MyWorld *world;
+	AsyncWriter writer;
+	ReplayRecord last;
+	std::vector<char> buffer;
+	
+	void write(const ReplayRecord &r) {
+		buffer.clear();
+		r.encode(buffer, last);
+		writer.write(buffer.data(), buffer.size());
+		last = r;
+	}
+
+public:
+	long keyframe_period;
+	
+	ReplayLog(MyWorld *w, const char *path, unsigned seed, long kp = 10000) : world(w), writer(path) {
+		keyframe_period = kp;
+		writer.write(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+		ReplayHeader h;
+		h.seed = seed;
+		h.eyes = uint32_t(world->sensors.eyes);
+		h.width = world->size.x();
+		h.height = world->size.y();
+		writer.write(&h, sizeof(h));
+		keyframe();
+	}
+	
+	bool good() const {
+		return writer.good();
+	}
+	
+	// the state is captured between steps, the background thread writes it out
+	void keyframe() {
+		Blob b;
+		Snapshot::save(*world, b);
+		write(ReplayRecord::base(world->step_index));
+		buffer.clear();
+		Varint::put(buffer, b.data.size());
+		writer.write(buffer.data(), buffer.size());
+		writer.write(std::move(b.data));
+	}
+	
+	void born(Organism *e, Organism *parent) override {
+		write(ReplayRecord::birth(world->step_index, e, parent));
+	}
+	
+	void died(Organism *e) override {
+		write(ReplayRecord::death(world->step_index, e));
+	}
+	
+	void stepped(long step) override {
+		if(keyframe_period > 0 && step % keyframe_period == 0) {
+			keyframe();
+		}
+	}
+	
+	void flush() {
+		writer.flush();
+	}
+	
+	// false if any write failed
+	bool close() {
+		return writer.close();
+	}
+};
+
+// Re-simulates a step range of a logged run from the nearest preceding keyframe
+// and checks that the regenerated events match the log.
+class Replay : public Listener {
+private:
+	FILE *file = nullptr;
+	ReplayRecord next, last;
+	bool has_next = false;
+	
+	// next record of the log and, for a keyframe, the size of its snapshot
+	bool read(ReplayRecord &r, uint64_t &bytes) {
+		if(!r.decode(file, last)) {
+			return false;
+		}
+		last = r;
+		return r.type != ReplayRecord::KEYFRAME || ReplayRecord::read(file, bytes);
+	}
+	
+	void advance() {
+		has_next = false;
+		uint64_t bytes = 0;
+		while(read(next, bytes)) {
+			if(next.type == ReplayRecord::KEYFRAME) {
+				fseek(file, long(bytes), SEEK_CUR);
+				continue;
+			}
+			has_next = true;
+			break;
+		}
+	}
+	
+	void check(const ReplayRecord &r) {
+		if(!has_next || !(next == r)) {
+			if(mismatches == 0) {
+				first_mismatch = r.step;
+			}
+			mismatches += 1;
+		}
+		advance();
+	}
+	
+public:
+	MyWorld *world = nullptr;
+	unsigned seed = 0;
+	// size of the logged world
+	vec2 world_size = nullvec2;
+	int eyes = 0;
+	long mismatches = 0, first_mismatch = -1;
+	
+	Replay(const char *path) {
+		file = fopen(path, "rb");
+		char magic[sizeof(REPLAY_MAGIC)];
+		if(file != nullptr && (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0)) {
+			fclose(file);
+			file = nullptr;
+		}
+		ReplayHeader h;
+		if(file != nullptr && fread(&h, sizeof(h), 1, file) != 1) {
+			fclose(file);
+			file = nullptr;
+		}
+		if(file != nullptr) {
+			seed = h.seed;
+			world_size = vec2(h.width, h.height);
+			eyes = int(h.eyes);
+		}
+	}
+	
+	~Replay() {
+		if(file != nullptr) {
+			fclose(file);
+		}
+	}
+	
+	bool good() const {
+		return file != nullptr;
+	}
+	
+	// restores the last keyframe at or before `from` into a fresh world `w`
+	bool seek(MyWorld *w, long from) {
+		world = w;
+		ReplayRecord r;
+		uint64_t bytes = 0;
+		long kf = -1, kf_step = 0;
+		std::vector<char> blob;
+		fseek(file, sizeof(REPLAY_MAGIC) + sizeof(ReplayHeader), SEEK_SET);
+		last = ReplayRecord();
+		while(read(r, bytes)) {
+			if(r.type == ReplayRecord::KEYFRAME) {
+				if(r.step > from) {
+					break;
+				}
+				blob.resize(size_t(bytes));
+				if(fread(blob.data(), 1, blob.size(), file) != blob.size()) {
+					return false;
+				}
+				kf = ftell(file);
+				kf_step = r.step;
+			}
+		}
+		if(kf < 0 || !Snapshot::load(*world, blob.data(), blob.size())) {
+			return false;
+		}
+		fseek(file, kf, SEEK_SET);
+		last = ReplayRecord::base(kf_step);
+		advance();
+		return true;
+	}
+	
+	// steps the restored world up to `to`, comparing events on the way
+	void run(long to) {
+		world->listeners.push_back(this);
+		while(world->step_index < to) {
+			world->step();
+		}
+		world->listeners.remove(this);
+	}
+	
+	void born(Organism *e, Organism *parent) override {
+		check(ReplayRecord::birth(world->step_index, e, parent));
+	}
+	
+	void died(Organism *e) override {
+		check(ReplayRecord::death(world->step_index, e));
+	}
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "organism.hpp"
+#include "listener.hpp"
+
+// Timing wheel of sleeping plants. A saturated plant does nothing but age until its death
+// step, which is known in advance, so it leaves the set of processed organisms and is put
+// back at that step, or earlier when it gets eaten. Ages are caught up on waking.
+class PlantScheduler : public Listener {
+private:
+	const long &step;
+	std::map<long, Organism*> &active;
+	std::vector<std::vector<Plant*>> slots;
+	long mask;
+	// sizes of the sleeping plants, they do not grow
+	std::multiset<double> sizes;
+	
+	void unlink(Plant *p) {
+		std::vector<Plant*> &slot = slots[p->wake & mask];
+		slot[p->wheel_slot] = slot.back();
+		slot[p->wheel_slot]->wheel_slot = p->wheel_slot;
+		slot.pop_back();
+		p->wheel_slot = -1;
+		sizes.erase(sizes.find(p->sleep_size));
+		sleeping -= 1;
+	}
+	
+public:
+	long sleeping = 0;
+	
+	PlantScheduler(const long &s, std::map<long, Organism*> &a) : step(s), active(a) {
+		long n = 1;
+		while(n < long(Plant::max_age) + 2) {
+			n *= 2;
+		}
+		slots.resize(n);
+		mask = n - 1;
+	}
+	
+	// called right after the process() of the plant in the current step,
+	// the caller removes it from the active set
+	void sleep(Plant *p) {
+		long k = p->lifetime();
+		if(k > mask) {
+			// woken early and put to sleep again
+			k = mask;
+		}
+		p->slept = step;
+		p->wake = step + k;
+		std::vector<Plant*> &slot = slots[p->wake & mask];
+		p->wheel_slot = int(slot.size());
+		slot.push_back(p);
+		p->sleep_size = p->size();
+		sizes.insert(p->sleep_size);
+		sleeping += 1;
+	}
+	
+	// largest sleeping plant
+	double max_size() const {
+		return sizes.empty() ? 0.0 : *sizes.rbegin();
+	}
+	
+	void wake(Plant *p) {
+		if(p->wheel_slot < 0) {
+			return;
+		}
+		unlink(p);
+		p->catch_up(step);
+		active[p->uid] = p;
+	}
+	
+	// wakes plants due in the current step, before the process phase
+	void advance() {
+		std::vector<Plant*> &slot = slots[step & mask];
+		while(!slot.empty()) {
+			wake(slot.back());
+		}
+	}
+	
+	void ate(Animal *, Organism *food, double) override {
+		if(food->kind() == KIND_PLANT) {
+			wake(static_cast<Plant*>(food));
+		}
+	}
+};
@@ -1,25 +1,35 @@
 #pragma once
 
 #include <list>
+#include <functional>
+
+#include <memory.hpp>
 
 #include "random.hpp"
 
 #include "organism.hpp"
 
 #include "mind.hpp"
+#include "optimizer.hpp"
 
 struct Champion {
 	double score;
 	Mind mind;
+	// the copied mind state, the genome is shared and charged to minds
+	MemoryCharge memory = MemoryCharge(MEM_SELECTOR);
 	
-	Champion(double s, const Mind &m) : score(s), mind(m) {}
+	Champion(double s, const Mind &m) : score(s), mind(m) {
+		memory.set(sizeof(Champion) + mind.footprint());
+	}
 };
 
 bool operator < (const Champion &a, const Champion &b) {
 	return a.score < b.score;
 }
 
-class Selector {
+// Keeps the best scoring minds; spawns get a random champion half the time and a
+// random mind otherwise.
+class Selector : public Optimizer {
 public:
 	std::list<Champion> champions;
 	double min_score = 0.0;
@@ -27,19 +37,35 @@ public:
 	
 	const int champions_max_count = 16;
 	
-	void add(Animal *a) {
+	// deaths not considered because the selector or the minds were over their budget
+	long refused = 0;
+	
+	// called with the uid of an animal whose mind enters or leaves the champions
+	std::function<void(long)> admitted = [](long){};
+	std::function<void(long)> evicted = [](long){};
+	
+	// Champions keep their genomes past the death of the animal, unlike the minds of the
+	// living which shrink with the population, so minds over budget stop admissions too.
+	void add(Animal *a) override {
+		if(Memory::get().over(MEM_SELECTOR) || Memory::get().over(MEM_MINDS)) {
+			refused += 1;
+			return;
+		}
 		float score = a->score();
 		if(score > min_score) {
 			auto it = champions.begin();
-			while(it->score < score && it != champions.end()) {
+			while(it != champions.end() && it->score < score) {
 				++it;
 			}
-			champions.insert(it, Champion(score, a->mind));
+			it = champions.insert(it, Champion(score, a->mind));
+			it->mind.origin = a->uid;
+			admitted(a->uid);
 		}
 	}
 	
-	void select() {
+	void select() override {
 		while(int(champions.size()) > champions_max_count) {
+			evicted(champions.front().mind.origin);
 			champions.pop_front();
 		}
 		for(auto &c : champions) {
@@ -51,7 +77,7 @@ public:
 		}
 	}
 	
-	const Mind *genMind() const {
+	const Mind *genMind() override {
 		if(champions.size() && rand_unif() > 0.5) {
 			int rp = rand_int() % champions.size();
 			auto it = champions.begin();
@@ -63,4 +89,8 @@ public:
 			return nullptr;
 		}
 	}
+	
+	const Mind *best() const override {
+		return champions.empty() ? nullptr : &champions.back().mind;
+	}
 };
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <memory.hpp>
+
+#include "myworld.hpp"
+#include "listener.hpp"
+
+// One quantity sampled at several resolutions, so that runs of any length plot from a few
+// hundred points. Level 0 keeps the last `capacity` samples; each point of level k + 1
+// aggregates `factor` points of level k into their mean and range. Adding a sample costs
+// amortized O(1) and never allocates.
+//
+// One thread writes, others read without locks: a reader copies a ring and then discards
+// the points the writer may have overwritten meanwhile.
+class Series {
+public:
+	static const int levels = 10, factor = 4;
+	
+	struct Sample {
+		float mean, lo, hi;
+	};
+
+private:
+	struct Point {
+		std::atomic<float> mean, lo, hi;
+	};
+	
+	struct Level {
+		std::unique_ptr<Point[]> ring;
+		// points written so far
+		std::atomic<long> head;
+		// aggregate of the points not yet passed to the next level
+		double sum = 0.0;
+		float lo = 0.0f, hi = 0.0f;
+		int n = 0;
+		
+		Level() : head(0) {}
+	};
+	
+	long capacity;
+	Level level[levels];
+	MemoryCharge memory = MemoryCharge(MEM_CHARTS);
+	
+	void push(int k, float mean, float lo, float hi) {
+		Level &l = level[k];
+		long h = l.head.load(std::memory_order_relaxed);
+		Point &p = l.ring[h % capacity];
+		p.mean.store(mean, std::memory_order_relaxed);
+		p.lo.store(lo, std::memory_order_relaxed);
+		p.hi.store(hi, std::memory_order_relaxed);
+		l.head.store(h + 1, std::memory_order_release);
+		
+		if(k + 1 < levels) {
+			l.sum += mean;
+			l.lo = l.n > 0 ? std::min(l.lo, lo) : lo;
+			l.hi = l.n > 0 ? std::max(l.hi, hi) : hi;
+			if(++l.n == factor) {
+				push(k + 1, float(l.sum/factor), l.lo, l.hi);
+				l.sum = 0.0;
+				l.n = 0;
+			}
+		}
+	}
+
+public:
+	Series(long c = 512) : capacity(c) {
+		for(Level &l : level) {
+			l.ring.reset(new Point[capacity]);
+		}
+		memory.set(levels*capacity*sizeof(Point));
+	}
+	
+	// writer thread only
+	void add(double v) {
+		push(0, float(v), float(v), float(v));
+	}
+	
+	// points written to level `k`, each spans factor^k samples
+	long size(int k) const {
+		return level[k].head.load(std::memory_order_acquire);
+	}
+	
+	// newest sample, 0 before the first
+	double last() const {
+		const Level &l = level[0];
+		long h = l.head.load(std::memory_order_acquire);
+		return h > 0 ? l.ring[(h - 1) % capacity].mean.load(std::memory_order_relaxed) : 0.0;
+	}
+	
+	// finest level that still holds the whole history, the coarsest if none does
+	int fit() const {
+		for(int k = 0; k < levels; ++k) {
+			if(size(k) <= capacity) {
+				return k;
+			}
+		}
+		return levels - 1;
+	}
+	
+	// copies the points of level `k` still in the ring, oldest first
+	void read(int k, std::vector<Sample> &out) const {
+		const Level &l = level[k];
+		out.clear();
+		long h = l.head.load(std::memory_order_acquire);
+		long begin = std::max(0L, h - capacity);
+		for(long i = begin; i < h; ++i) {
+			const Point &p = l.ring[i % capacity];
+			out.push_back(Sample{p.mean.load(std::memory_order_relaxed), p.lo.load(std::memory_order_relaxed), p.hi.load(std::memory_order_relaxed)});
+		}
+		// the slot after the head may be being written as well
+		long valid = l.head.load(std::memory_order_acquire) + 1 - capacity;
+		if(valid > begin) {
+			out.erase(out.begin(), out.begin() + std::min(long(out.size()), valid - begin));
+		}
+	}
+};
+
+enum SeriesId {
+	SERIES_PLANTS = 0,
+	SERIES_HERBIVORES,
+	SERIES_CARNIVORES,
+	SERIES_HERBIVORE_ENERGY,
+	SERIES_CARNIVORE_ENERGY,
+	SERIES_HERBIVORE_CHAMPION,
+	SERIES_CARNIVORE_CHAMPION,
+	SERIES_STEP_DURATION,
+	SERIES_COUNT
+};
+
+// Series of the world sampled every step by the step thread, for the charts of the panel,
+// and the latest values of the labels that have no chart. The statistics are changed by
+// the step thread, the GUI thread reads only what is published here.
+class Timeline : public Listener {
+private:
+	const MyWorld &world;
+
+public:
+	Series series[SERIES_COUNT];
+	std::atomic<long> plants, oldest, ancestry;
+	std::atomic<double> plant_energy, birth_rate, neighbor_rate;
+	
+	Timeline(const MyWorld &w) :
+		world(w), plants(0), oldest(0), ancestry(0), plant_energy(0.0), birth_rate(0.0), neighbor_rate(0.0)
+	{}
+	
+	const Series &operator[](SeriesId id) const {
+		return series[id];
+	}
+	
+	void stepped(long) override {
+		const SpeciesStats &h = world.stats[KIND_HERBIVORE], &c = world.stats[KIND_CARNIVORE], &p = world.stats[KIND_PLANT];
+		long step = world.stats.step;
+		plants = p.count;
+		plant_energy = p.energy;
+		oldest = std::max(h.ages.oldest(step), c.ages.oldest(step));
+		ancestry = std::max(h.ancestry.max(), c.ancestry.max());
+		birth_rate = h.birth_rate + c.birth_rate;
+		neighbor_rate = world.neighbors.rate();
+		series[SERIES_PLANTS].add(world.stats[KIND_PLANT].count);
+		series[SERIES_HERBIVORES].add(h.count);
+		series[SERIES_CARNIVORES].add(c.count);
+		series[SERIES_HERBIVORE_ENERGY].add(h.count > 0 ? h.energy/h.count : 0.0);
+		series[SERIES_CARNIVORE_ENERGY].add(c.count > 0 ? c.energy/c.count : 0.0);
+		series[SERIES_HERBIVORE_CHAMPION].add(world.hsel.max_score);
+		series[SERIES_CARNIVORE_CHAMPION].add(world.csel.max_score);
+		// of the previous step, the current one is measured after its listeners
+		series[SERIES_STEP_DURATION].add(world.step_duration);
+	}
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <ctime>
+#include <vector>
+
+#include "myworld.hpp"
+#include "spawn.hpp"
+#include "archive.hpp"
+
+static const vec2 default_world_size = vec2(1000, 1600);
+
+// default layout: herbivore and carnivore spawns at the poles, each with a plant patch, and a large plant field in the middle
+inline void populate(MyWorld &world, const vec2 &at = nullvec2) {
+	world.add(new SpawnHerbivore(at + vec2(0, 1500), 100, 10, 0));
+	world.add(new SpawnPlant(at + vec2(0, 1300), 300, 0, 100));
+	
+	world.add(new SpawnPlant(at + vec2(0, 0), 1000, 0, 200));
+	
+	world.add(new SpawnCarnivore(at + vec2(0, -1500), 100, 10, 0));
+	world.add(new SpawnPlant(at + vec2(0, -1300), 300, 0, 100));
+}
+
+// large map: a world of `tiles` x `tiles` default-sized tiles with the default layout in
+// `clusters` tiles chosen at random, the rest of the map stays empty
+inline void scatter(MyWorld &world, int tiles, int clusters) {
+	std::vector<int> free;
+	for(int k = 0; k < tiles*tiles; ++k) {
+		free.push_back(k);
+	}
+	for(int n = 0; n < clusters && !free.empty(); ++n) {
+		int r = rand_int() % int(free.size());
+		int k = free[r];
+		free[r] = free.back();
+		free.pop_back();
+		vec2 at = -world.size + vec2((2*(k % tiles) + 1)*default_world_size.x(), (2*(k/tiles) + 1)*default_world_size.y());
+		populate(world, at);
+	}
+}
+
+
+// puts the best archived minds of both species among the champions, so spawns start from them
+inline int seed(MyWorld &world, const Archive &archive, int count = 16) {
+	Herbivore h(world.sensors);
+	Carnivore c(world.sensors);
+	return archive.seed(world.hsel, KIND_HERBIVORE, h.mind, count) + archive.seed(world.csel, KIND_CARNIVORE, c.mind, count);
+}
+
+// queues the current champions of both species
+inline void store(const MyWorld &world, Archive &archive, unsigned seed) {
+	ArchiveMeta meta;
+	meta.seed = seed;
+	meta.step = world.step_index;
+	meta.time = time(nullptr);
+	archive.append(KIND_HERBIVORE, world.hsel, meta);
+	archive.append(KIND_CARNIVORE, world.csel, meta);
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <functional>
+
+#include "random.hpp"
+#include "myworld.hpp"
+
+// Runs a reference world next to a world under test, both built by the same setup from
+// the same seed, and compares every organism after every step. The reference takes the
+// straightforward passes of MyWorld (see MyWorld::reference) on one thread, so any fast
+// path of the tested world, such as the plant field, the chunk broad phase, the eye grid
+// or the step threads, is checked against them.
+//
+// Each world keeps its own generator state, so the worlds draw the same numbers as long
+// as they agree. Values agree when they differ by at most `tolerance` relative to their
+// magnitude; a NaN or infinite value on either side is a divergence. Approximations of
+// the fast paths need a matching tolerance or to be turned off: the plant field with an
+// opening angle of 0 is exact, while even differences of 1e-3 in a sensor grow and
+// diverge the run within some steps.
+class Shadow {
+private:
+	MyWorld &world;
+	MyWorld ref;
+	std::string world_rng, ref_rng;
+	
+	std::string text;
+	
+	bool close(double a, double b) const {
+		if(!std::isfinite(a) || !std::isfinite(b)) {
+			return false;
+		}
+		return fabs(a - b) <= tolerance*(1.0 + std::max(fabs(a), fabs(b)));
+	}
+	
+	// names the quantity if it is NaN or infinite
+	static void nonfinite(std::string &out, const char *name, double v) {
+		if(!std::isfinite(v)) {
+			out += std::string(out.empty() ? "" : ", ") + name + " is " + (std::isnan(v) ? "NaN" : v > 0.0 ? "+inf" : "-inf");
+		}
+	}
+	
+	static const char *kind_name(Kind k) {
+		static const char *names[KIND_COUNT] = {"none", "plant", "herbivore", "carnivore", "plant spawn", "herbivore spawn", "carnivore spawn"};
+		return names[k];
+	}
+	
+	void describe(const Organism *e, const char *who) {
+		char buf[256];
+		snprintf(buf, sizeof(buf), "  %-9s pos (%.9g, %.9g), energy %.9g, score %.9g, age %d%s\n",
+			who, e->pos.x(), e->pos.y(), double(e->energy), double(e->score()), e->age, e->alive ? "" : ", dead"
+		);
+		text += buf;
+		if(auto a = dynamic_cast<const Animal*>(e)) {
+			text += std::string("  ") + std::string(9, ' ') + " inputs";
+			for(float v : a->mind.input) {
+				snprintf(buf, sizeof(buf), " %.6g", v);
+				text += buf;
+			}
+			text += "\n";
+		}
+		std::string bad;
+		nonfinite(bad, "x", e->pos.x());
+		nonfinite(bad, "y", e->pos.y());
+		nonfinite(bad, "energy", e->energy);
+		nonfinite(bad, "score", e->score());
+		if(auto a = dynamic_cast<const Animal*>(e)) {
+			for(size_t i = 0; i < a->mind.input.size(); ++i) {
+				nonfinite(bad, ("input " + std::to_string(i)).c_str(), a->mind.input[i]);
+			}
+			for(size_t i = 0; i < a->mind.output.size(); ++i) {
+				nonfinite(bad, ("output " + std::to_string(i)).c_str(), a->mind.output[i]);
+			}
+		}
+		if(!bad.empty()) {
+			text += std::string("  ") + std::string(9, ' ') + " non-finite: " + bad + "\n";
+		}
+	}
+	
+	// first disagreement of two organisms of the same uid, null if they agree
+	const char *differ(const Organism *a, const Organism *b) const {
+		if(a->kind() != b->kind()) {
+			return "kind";
+		}
+		if(a->alive != b->alive) {
+			return "alive";
+		}
+		// in causal order: what was sensed, decided, then done
+		auto x = dynamic_cast<const Animal*>(a), y = dynamic_cast<const Animal*>(b);
+		if(x != nullptr) {
+			for(size_t i = 0; i < x->mind.input.size(); ++i) {
+				if(!close(x->mind.input[i], y->mind.input[i])) {
+					return "mind input";
+				}
+			}
+			for(size_t i = 0; i < x->mind.output.size(); ++i) {
+				if(!close(x->mind.output[i], y->mind.output[i])) {
+					return "mind output";
+				}
+			}
+			if(!close(x->dir.x(), y->dir.x()) || !close(x->dir.y(), y->dir.y())) {
+				return "heading";
+			}
+		}
+		if(!close(a->pos.x(), b->pos.x()) || !close(a->pos.y(), b->pos.y())) {
+			return "position";
+		}
+		if(!close(a->energy, b->energy)) {
+			return "energy";
+		}
+		if(!close(a->score(), b->score())) {
+			return "score";
+		}
+		return nullptr;
+	}
+	
+	void diverge(long uid, const char *what, const Organism *a, const Organism *b) {
+		char buf[256];
+		const Organism *e = a != nullptr ? a : b;
+		snprintf(buf, sizeof(buf), "diverged at step %ld, last agreement at step %ld: %s %ld, %s\n",
+			world.step_index, world.step_index - 1, kind_name(e->kind()), uid, what
+		);
+		text = buf;
+		if(a != nullptr) {
+			describe(a, "tested");
+		}
+		if(b != nullptr) {
+			describe(b, "reference");
+		}
+		diverged = world.step_index;
+	}
+	
+	bool compare() {
+		auto i = world.where.begin(), j = ref.where.begin();
+		while(i != world.where.end() || j != ref.where.end()) {
+			if(j == ref.where.end() || (i != world.where.end() && i->first < j->first)) {
+				diverge(i->first, "only in the tested world", static_cast<Organism*>(i->second->second), nullptr);
+				return false;
+			}
+			if(i == world.where.end() || j->first < i->first) {
+				diverge(j->first, "only in the reference world", nullptr, static_cast<Organism*>(j->second->second));
+				return false;
+			}
+			const Organism *a = static_cast<Organism*>(i->second->second), *b = static_cast<Organism*>(j->second->second);
+			if(const char *what = differ(a, b)) {
+				diverge(i->first, what, a, b);
+				return false;
+			}
+			compared += 1;
+			++i;
+			++j;
+		}
+		if(world_rng != ref_rng) {
+			char buf[128];
+			snprintf(buf, sizeof(buf), "diverged at step %ld: the worlds drew different random numbers\n", world.step_index);
+			text = buf;
+			diverged = world.step_index;
+			return false;
+		}
+		return true;
+	}
+
+public:
+	double tolerance;
+	// step of the first divergence, -1 while the worlds agree
+	long diverged = -1;
+	// organism states compared so far
+	long compared = 0;
+	
+	// `setup` populates a world from the current generator state, it is called for the
+	// tested world right away and then for the reference from the same state
+	Shadow(MyWorld &w, const std::function<void(MyWorld&)> &setup, double tol = 1e-9) :
+		world(w), ref(w.size), tolerance(tol)
+	{
+		ref.reference = true;
+		ref.neighbors.skin = 0.0;
+		ref.sensors = world.sensors;
+		std::string start = rand_state();
+		setup(world);
+		world_rng = rand_state();
+		rand_restore(start);
+		setup(ref);
+		ref_rng = rand_state();
+		rand_restore(world_rng);
+		ref.adaptive = world.adaptive;
+		ref.dt_max = world.dt_max;
+	}
+	
+	// steps both worlds, false once they have diverged
+	bool step() {
+		if(diverged >= 0) {
+			return false;
+		}
+		rand_restore(world_rng);
+		world.step();
+		world_rng = rand_state();
+		rand_restore(ref_rng);
+		ref.step();
+		ref_rng = rand_state();
+		rand_restore(world_rng);
+		return compare();
+	}
+	
+	const MyWorld &reference() const {
+		return ref;
+	}
+	
+	// the first divergence with the state of the organism in both worlds
+	const std::string &report() const {
+		return text;
+	}
+};
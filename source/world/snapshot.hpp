@@ -0,0 +1,346 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "myworld.hpp"
+
+// Plain binary buffer for world state
+class Blob {
+public:
+	std::vector<char> data;
+	
+	template <typename T>
+	void put(const T &v) {
+		const char *p = reinterpret_cast<const char*>(&v);
+		data.insert(data.end(), p, p + sizeof(T));
+	}
+	
+	void put(const vec2 &v) {
+		put(v.x());
+		put(v.y());
+	}
+	
+	void put(const std::string &s) {
+		put(int(s.size()));
+		data.insert(data.end(), s.begin(), s.end());
+	}
+	
+	void put(const std::vector<float> &v) {
+		put(int(v.size()));
+		const char *p = reinterpret_cast<const char*>(v.data());
+		data.insert(data.end(), p, p + sizeof(float)*v.size());
+	}
+};
+
+class BlobReader {
+private:
+	const char *pos, *end;
+public:
+	bool ok = true;
+	
+	BlobReader(const char *d, size_t s) : pos(d), end(d + s) {}
+	
+	template <typename T>
+	void get(T &v) {
+		if(pos + sizeof(T) > end) {
+			ok = false;
+			return;
+		}
+		memcpy(&v, pos, sizeof(T));
+		pos += sizeof(T);
+	}
+	
+	void get(vec2 &v) {
+		double x = 0.0, y = 0.0;
+		get(x);
+		get(y);
+		v = vec2(x, y);
+	}
+	
+	void get(std::string &s) {
+		int n = 0;
+		get(n);
+		if(n < 0 || pos + n > end) {
+			ok = false;
+			return;
+		}
+		s.assign(pos, n);
+		pos += n;
+	}
+	
+	void get(std::vector<float> &v) {
+		int n = 0;
+		get(n);
+		if(n < 0 || pos + sizeof(float)*n > end) {
+			ok = false;
+			return;
+		}
+		v.resize(n);
+		memcpy(v.data(), pos, sizeof(float)*n);
+		pos += sizeof(float)*n;
+	}
+};
+
+// Full world state: organisms, spawns, selectors, shared genomes and the random generator.
+// Genomes shared between several minds are stored once.
+class Snapshot {
+private:
+	static void collect(std::map<const Genome*, int> &ids, std::vector<const Genome*> &list, const Mind &m) {
+		const Genome *g = m.genome.get();
+		if(ids.find(g) == ids.end()) {
+			ids[g] = int(list.size());
+			list.push_back(g);
+		}
+	}
+	
+	static void save_mind(Blob &b, std::map<const Genome*, int> &ids, const Mind &m) {
+		b.put(ids[m.genome.get()]);
+		b.put(m.origin);
+		b.put(m.input);
+		b.put(m.output);
+		b.put(m.memory);
+	}
+	
+	// minds of another shape than `shape` are rejected, animals view their state in place
+	static void load_mind(BlobReader &r, const std::vector<std::shared_ptr<const Genome>> &genomes, const Mind &shape, Mind &m) {
+		int gi = -1;
+		r.get(gi);
+		r.get(m.origin);
+		r.get(m.input);
+		r.get(m.output);
+		r.get(m.memory);
+		if(gi < 0 || gi >= int(genomes.size()) || genomes[gi]->size() != shape.weight_size()) {
+			r.ok = false;
+			return;
+		}
+		if(m.input.size() != shape.input.size() || m.output.size() != shape.output.size() || m.memory.size() != shape.memory.size()) {
+			r.ok = false;
+			return;
+		}
+		m.genome = genomes[gi];
+	}
+	
+	static void save_selector(Blob &b, std::map<const Genome*, int> &ids, const Selector &s) {
+		b.put(s.min_score);
+		b.put(s.max_score);
+		b.put(int(s.champions.size()));
+		for(const Champion &c : s.champions) {
+			b.put(c.score);
+			save_mind(b, ids, c.mind);
+		}
+	}
+	
+	static void load_selector(BlobReader &r, const std::vector<std::shared_ptr<const Genome>> &genomes, const Mind &shape, Selector &s) {
+		int n = 0;
+		r.get(s.min_score);
+		r.get(s.max_score);
+		r.get(n);
+		s.champions.clear();
+		for(int i = 0; i < n && r.ok; ++i) {
+			double score = 0.0;
+			r.get(score);
+			Mind m(0, 0, 0, 0);
+			load_mind(r, genomes, shape, m);
+			s.champions.push_back(Champion(score, m));
+		}
+	}
+	
+	static Organism *instance(const Sensors &s, Kind k, const vec2 &p, double rad, double t, int n) {
+		switch(k) {
+		case KIND_PLANT:
+			return new Plant();
+		case KIND_HERBIVORE:
+			return new Herbivore(s);
+		case KIND_CARNIVORE:
+			return new Carnivore(s);
+		case KIND_SPAWN_PLANT:
+			return new SpawnPlant(p, rad, t, n);
+		case KIND_SPAWN_HERBIVORE:
+			return new SpawnHerbivore(p, rad, t, n);
+		case KIND_SPAWN_CARNIVORE:
+			return new SpawnCarnivore(p, rad, t, n);
+		default:
+			return nullptr;
+		}
+	}
+	
+public:
+	static void save(const MyWorld &w, Blob &b) {
+		std::map<const Genome*, int> ids;
+		std::vector<const Genome*> genomes;
+		for(const Champion &c : w.hsel.champions) {
+			collect(ids, genomes, c.mind);
+		}
+		for(const Champion &c : w.csel.champions) {
+			collect(ids, genomes, c.mind);
+		}
+		for(auto &p : w.entities) {
+			if(auto a = dynamic_cast<const Animal*>(p.second)) {
+				collect(ids, genomes, a->mind);
+			}
+		}
+		
+		// the sensor layout goes first, it sets the shape of the minds that follow
+		b.put(w.sensors.eyes);
+		b.put(w.step_index);
+		b.put(w.next_uid);
+		b.put(w.adaptive);
+		b.put(w.dt);
+		b.put(w.dt_min);
+		b.put(w.dt_max);
+		b.put(w.courant);
+		b.put(w.max_turn);
+		b.put(w.max_substeps);
+		b.put(w.time);
+		b.put(rand_state());
+		
+		b.put(int(genomes.size()));
+		for(const Genome *g : genomes) {
+			b.put(g->seed);
+			b.put(g->delta);
+			b.put(std::vector<float>(g->data(), g->data() + g->size()));
+		}
+		
+		save_selector(b, ids, w.hsel);
+		save_selector(b, ids, w.csel);
+		
+		b.put(int(w.entities.size()));
+		for(auto &p : w.entities) {
+			const Organism *e = static_cast<const Organism*>(p.second);
+			b.put(int(e->kind()));
+			b.put(e->uid);
+			b.put(e->pos);
+			b.put(e->vel);
+			if(auto s = dynamic_cast<const Spawn*>(e)) {
+				b.put(s->rad);
+				b.put(s->max_time);
+				b.put(s->max_count);
+			}
+			// stored in double whatever the state precision
+			b.put(double(e->energy));
+			b.put(double(e->_score));
+			b.put(e->alive);
+			// sleeping plants have not been aged since they fell asleep
+			long skipped = e->kind() == KIND_PLANT ? static_cast<const Plant*>(e)->skipped(w.step_index) : 0;
+			b.put(e->total_age + skipped);
+			b.put(e->age + int(skipped));
+			b.put(e->aged + skipped);
+			b.put(e->anc);
+			if(auto s = dynamic_cast<const Spawn*>(e)) {
+				b.put(s->timer);
+				b.put(s->instant);
+				b.put(s->count);
+			} else if(auto pl = dynamic_cast<const Plant*>(e)) {
+				b.put(pl->max_score);
+			} else if(auto a = dynamic_cast<const Animal*>(e)) {
+				b.put(a->dir);
+				b.put(a->spin);
+				save_mind(b, ids, a->mind);
+			}
+		}
+	}
+	
+	// restores into a freshly constructed world
+	static bool load(MyWorld &w, const char *data, size_t size) {
+		BlobReader r(data, size);
+		std::string rs;
+		
+		int eyes = -1;
+		r.get(eyes);
+		if(!r.ok || eyes < 0) {
+			return false;
+		}
+		w.sensors.eyes = eyes;
+		// minds are checked against a prototype of the restored layout
+		Herbivore proto(w.sensors);
+		
+		r.get(w.step_index);
+		r.get(w.next_uid);
+		r.get(w.adaptive);
+		r.get(w.dt);
+		r.get(w.dt_min);
+		r.get(w.dt_max);
+		r.get(w.courant);
+		r.get(w.max_turn);
+		r.get(w.max_substeps);
+		r.get(w.time);
+		w.clock = w.step_index;
+		r.get(rs);
+		
+		int ng = 0;
+		r.get(ng);
+		std::vector<std::shared_ptr<const Genome>> genomes;
+		for(int i = 0; i < ng && r.ok; ++i) {
+			std::shared_ptr<Genome> g = std::make_shared<Genome>(0);
+			r.get(g->seed);
+			r.get(g->delta);
+			r.get(g->weight);
+			g->account();
+			genomes.push_back(g);
+		}
+		
+		load_selector(r, genomes, proto.mind, w.hsel);
+		load_selector(r, genomes, proto.mind, w.csel);
+		
+		int ne = 0;
+		r.get(ne);
+		for(int i = 0; i < ne && r.ok; ++i) {
+			int k = 0;
+			long uid = -1;
+			vec2 pos, vel;
+			r.get(k);
+			r.get(uid);
+			r.get(pos);
+			r.get(vel);
+			
+			double rad = 0.0, max_time = 0.0;
+			int max_count = 0;
+			if(k >= KIND_SPAWN_PLANT) {
+				r.get(rad);
+				r.get(max_time);
+				r.get(max_count);
+			}
+			Organism *e = instance(w.sensors, Kind(k), pos, rad, max_time, max_count);
+			if(e == nullptr) {
+				return false;
+			}
+			e->uid = uid;
+			e->pos = pos;
+			e->vel = vel;
+			double energy = 0.0, score = 0.0;
+			r.get(energy);
+			r.get(score);
+			e->energy = real(energy);
+			e->_score = real(score);
+			r.get(e->alive);
+			r.get(e->total_age);
+			r.get(e->age);
+			r.get(e->aged);
+			r.get(e->anc);
+			if(auto s = dynamic_cast<Spawn*>(e)) {
+				r.get(s->timer);
+				r.get(s->instant);
+				r.get(s->count);
+			} else if(auto pl = dynamic_cast<Plant*>(e)) {
+				r.get(pl->max_score);
+			} else if(auto a = dynamic_cast<Animal*>(e)) {
+				r.get(a->dir);
+				r.get(a->spin);
+				load_mind(r, genomes, proto.mind, a->mind);
+			}
+			if(!r.ok) {
+				delete e;
+				return false;
+			}
+			w.add(e);
+		}
+		
+		// plant constructors draw from the generator, so its state goes last
+		rand_restore(rs);
+		return r.ok;
+	}
+};
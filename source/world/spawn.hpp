@@ -38,9 +38,9 @@ public:
 		}
 	}
 	
-	virtual void process() override {
-		Organism::process();
-		timer += 1;
+	virtual void process(double tick) override {
+		Organism::process(tick);
+		timer += tick;
 	}
 	
 	virtual std::list<Organism*> produce() override {
@@ -64,6 +64,10 @@ public:
 	template <typename ... Args>
 	SpawnPlant(Args ... args) : Spawn(args...) {}
 	
+	Kind kind() const override {
+		return KIND_SPAWN_PLANT;
+	}
+	
 	Plant *instance() const override {
 		Plant *a = new Plant();
 		
@@ -78,9 +82,17 @@ public:
 	}
 };
 
+// mind a spawned animal is derived from, null for a random one, and whether it is mutated
+struct SpawnMind {
+	const Mind *mind;
+	bool vary;
+};
+
 class SpawnAnimal : public Spawn {
 public:
-	std::function<const Mind*()> mindgen = [](){return nullptr;};
+	std::function<SpawnMind()> mindgen = [](){return SpawnMind{nullptr, true};};
+	// of the spawned animals, set by the world the spawn is added to
+	Sensors sensors;
 	
 	template <typename ... Args>
 	SpawnAnimal(Args ... args) : Spawn(args...) {}
@@ -95,12 +107,18 @@ public:
 	template <typename ... Args>
 	SpawnHerbivore(Args ... args) : SpawnAnimal(args...) {}
 	
+	Kind kind() const override {
+		return KIND_SPAWN_HERBIVORE;
+	}
+	
 	Herbivore *instance() const override {
-		const Mind *m = mindgen();
-		Herbivore *a = new Herbivore(m);
+		SpawnMind m = mindgen();
+		Herbivore *a = new Herbivore(sensors, m.mind);
 		
-		if(m != nullptr) {
-			a->mind.vary(rand_norm, a->mind_delta);
+		if(m.mind != nullptr) {
+			if(m.vary) {
+				a->mind.vary(unsigned(rand_int()), a->mind_delta);
+			}
 		} else {
 			a->mind.randomize(rand_norm);
 		}
@@ -120,12 +138,18 @@ public:
 	template <typename ... Args>
 	SpawnCarnivore(Args ... args) : SpawnAnimal(args...) {}
 	
+	Kind kind() const override {
+		return KIND_SPAWN_CARNIVORE;
+	}
+	
 	Carnivore *instance() const override {
-		const Mind *m = mindgen();
-		Carnivore *a = new Carnivore(m);
+		SpawnMind m = mindgen();
+		Carnivore *a = new Carnivore(sensors, m.mind);
 		
-		if(m != nullptr) {
-			a->mind.vary(rand_norm, a->mind_delta);
+		if(m.mind != nullptr) {
+			if(m.vary) {
+				a->mind.vary(unsigned(rand_int()), a->mind_delta);
+			}
 		} else {
 			a->mind.randomize(rand_norm);
 		}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+#include "organism.hpp"
+#include "listener.hpp"
+
+// Number of living organisms by birth step. Births arrive in step order,
+// so the oldest one is kept at the front in amortized O(1).
+class AgeTracker {
+private:
+	std::deque<long> counts;
+	long first = 0;
+public:
+	void insert(long birth) {
+		if(counts.empty()) {
+			first = birth;
+		} else if(birth < first) {
+			counts.insert(counts.begin(), size_t(first - birth), 0);
+			first = birth;
+		}
+		size_t i = size_t(birth - first);
+		if(i >= counts.size()) {
+			counts.resize(i + 1, 0);
+		}
+		counts[i] += 1;
+	}
+	
+	void erase(long birth) {
+		long i = birth - first;
+		if(i < 0 || i >= long(counts.size())) {
+			return;
+		}
+		counts[i] -= 1;
+		while(!counts.empty() && counts.front() <= 0) {
+			counts.pop_front();
+			first += 1;
+		}
+	}
+	
+	long oldest(long step) const {
+		return counts.empty() ? 0 : step - first;
+	}
+};
+
+// Histogram over small non-negative integers with its maximum.
+// The maximum grows by at most one per birth, so lowering it on removal is amortized O(1).
+class MaxTracker {
+private:
+	std::vector<long> counts;
+	int top = -1;
+public:
+	void insert(int v) {
+		if(v < 0) {
+			v = 0;
+		}
+		if(v >= int(counts.size())) {
+			counts.resize(v + 1, 0);
+		}
+		counts[v] += 1;
+		if(v > top) {
+			top = v;
+		}
+	}
+	
+	void erase(int v) {
+		if(v < 0) {
+			v = 0;
+		}
+		if(v >= int(counts.size())) {
+			return;
+		}
+		counts[v] -= 1;
+		while(top >= 0 && counts[top] <= 0) {
+			top -= 1;
+		}
+	}
+	
+	int max() const {
+		return top < 0 ? 0 : top;
+	}
+};
+
+struct SpeciesStats {
+	static const int SCORE_BINS = 32;
+	
+	long count = 0;
+	long births = 0, deaths = 0, meals = 0;
+	double energy = 0.0;
+	
+	// exponential averages of births and deaths per step
+	double birth_rate = 0.0, death_rate = 0.0;
+	long step_births = 0, step_deaths = 0;
+	
+	AgeTracker ages;
+	MaxTracker ancestry;
+	
+	// final scores, bin i holds scores in [2^i - 1, 2^(i + 1) - 1)
+	long score_hist[SCORE_BINS] = {0};
+	
+	static int score_bin(double score) {
+		int b = score > 0.0 ? int(log2(score + 1.0)) : 0;
+		return b < SCORE_BINS ? b : SCORE_BINS - 1;
+	}
+};
+
+// Population statistics maintained from world events, no pass over entities is needed.
+class Stats : public Listener {
+public:
+	static constexpr const double rate_factor = 1e-2;
+	
+	// step of the world in which organisms added now are first processed,
+	// organisms are keyed by that step minus their age for age tracking
+	const long &step;
+	SpeciesStats species[KIND_COUNT];
+	
+	Stats(const long &s) : step(s) {}
+	
+	const SpeciesStats &operator [](Kind k) const {
+		return species[k];
+	}
+	
+	void added(Organism *e) override {
+		SpeciesStats &s = species[e->kind()];
+		s.count += 1;
+		s.energy += e->energy;
+		s.ages.insert(step - e->age);
+		s.ancestry.insert(e->anc);
+	}
+	
+	void born(Organism *e, Organism *parent) override {
+		SpeciesStats &s = species[e->kind()];
+		s.births += 1;
+		s.step_births += 1;
+	}
+	
+	void died(Organism *e) override {
+		SpeciesStats &s = species[e->kind()];
+		s.count -= 1;
+		s.energy -= e->energy;
+		s.ages.erase(step - e->age);
+		s.ancestry.erase(e->anc);
+		s.deaths += 1;
+		s.step_deaths += 1;
+		if(dynamic_cast<Animal*>(e) != nullptr) {
+			s.score_hist[SpeciesStats::score_bin(e->score())] += 1;
+		}
+	}
+	
+	void ate(Animal *e, Organism *food, double energy) override {
+		species[food->kind()].energy -= energy;
+		SpeciesStats &s = species[e->kind()];
+		s.energy += energy*e->eat_factor;
+		s.meals += 1;
+	}
+	
+	// energy change of an organism during its own process() call
+	void drift(const Organism *e, double delta) {
+		species[e->kind()].energy += delta;
+	}
+	
+	void stepped(long) override {
+		for(SpeciesStats &s : species) {
+			s.birth_rate += rate_factor*(s.step_births - s.birth_rate);
+			s.death_rate += rate_factor*(s.step_deaths - s.death_rate);
+			s.step_births = 0;
+			s.step_deaths = 0;
+		}
+	}
+	
+	void print(FILE *f) const {
+		static const char *names[] = {"plant", "herbivore", "carnivore"};
+		static const Kind kinds[] = {KIND_PLANT, KIND_HERBIVORE, KIND_CARNIVORE};
+		for(int i = 0; i < 3; ++i) {
+			const SpeciesStats &s = species[kinds[i]];
+			fprintf(f, "  %-10s count %6ld, energy %10.1f, oldest %6ld, ancestry %4d, births/step %6.3f, deaths/step %6.3f\n",
+				names[i], s.count, s.energy, s.ages.oldest(step), s.ancestry.max(), s.birth_rate, s.death_rate
+			);
+		}
+	}
+};
@@ -0,0 +1,524 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <memory.hpp>
+#include <varint.hpp>
+
+#include "myworld.hpp"
+#include "listener.hpp"
+
+#define STREAM_MAGIC "NEVOSTR1"
+
+enum StreamType {
+	STREAM_PAD = 0,
+	STREAM_KEY,
+	STREAM_DELTA
+};
+
+// organism as seen by a viewer: position quantized over the world extent, size in 1/16
+// units, heading in 1/256 turns
+struct StreamBody {
+	long uid;
+	uint8_t kind, dir;
+	uint16_t size, x, y;
+	
+	bool operator == (const StreamBody &b) const {
+		return uid == b.uid && kind == b.kind && dir == b.dir && size == b.size && x == b.x && y == b.y;
+	}
+	bool operator != (const StreamBody &b) const {
+		return !(*this == b);
+	}
+	
+	static uint16_t quantize(double v, double h) {
+		double q = floor(65535.0*0.5*(v/h + 1.0) + 0.5);
+		return uint16_t(std::min(65535.0, std::max(0.0, q)));
+	}
+	
+	static StreamBody make(const Organism *e, const vec2 &ws) {
+		StreamBody b;
+		b.uid = e->uid;
+		b.kind = e->kind();
+		b.size = uint16_t(std::min(65535.0, floor(16.0*e->size() + 0.5)));
+		b.x = quantize(e->pos.x(), ws.x());
+		b.y = quantize(e->pos.y(), ws.y());
+		b.dir = 0;
+		if(auto a = dynamic_cast<const Animal*>(e)) {
+			b.dir = uint8_t(long(floor(128.0*atan2(a->dir.y(), a->dir.x())/M_PI + 0.5)) & 255);
+		}
+		return b;
+	}
+	
+	vec2 position(const vec2 &ws) const {
+		return vec2((2.0*x/65535.0 - 1.0)*ws.x(), (2.0*y/65535.0 - 1.0)*ws.y());
+	}
+	double radius() const {
+		return size/16.0;
+	}
+	vec2 heading() const {
+		double a = M_PI*dir/128.0;
+		return vec2(cos(a), sin(a));
+	}
+};
+
+struct StreamSpecies {
+	uint32_t count = 0;
+	int32_t oldest = 0;
+	float energy = 0.0f, birth_rate = 0.0f, death_rate = 0.0f;
+};
+
+// A keyframe holds every body, a delta frame only the bodies that changed since the previous
+// frame and the uids of those that are gone. Uids are sorted and stored as varint gaps.
+struct StreamFrame {
+	int type = STREAM_KEY;
+	int64_t step = 0;
+	StreamSpecies species[3];
+	std::vector<long> removed;
+	std::vector<StreamBody> bodies;
+	
+	template <typename T>
+	static void put(std::vector<char> &out, const T &v) {
+		const char *p = reinterpret_cast<const char*>(&v);
+		out.insert(out.end(), p, p + sizeof(T));
+	}
+	
+	template <typename T>
+	static bool get(const char *&p, const char *end, T &v) {
+		if(p + sizeof(T) > end) {
+			return false;
+		}
+		memcpy(&v, p, sizeof(T));
+		p += sizeof(T);
+		return true;
+	}
+	
+	void encode(std::vector<char> &out) const {
+		out.clear();
+		put(out, step);
+		for(const StreamSpecies &s : species) {
+			put(out, s);
+		}
+		Varint::put(out, removed.size());
+		long last = -1;
+		for(long uid : removed) {
+			Varint::put(out, uint64_t(uid - last));
+			last = uid;
+		}
+		Varint::put(out, bodies.size());
+		last = -1;
+		for(const StreamBody &b : bodies) {
+			Varint::put(out, uint64_t(b.uid - last));
+			last = b.uid;
+			put(out, b.kind);
+			put(out, b.dir);
+			put(out, b.size);
+			put(out, b.x);
+			put(out, b.y);
+		}
+	}
+	
+	bool decode(int t, const char *p, size_t n) {
+		const char *end = p + n;
+		type = t;
+		if(!get(p, end, step)) {
+			return false;
+		}
+		for(StreamSpecies &s : species) {
+			if(!get(p, end, s)) {
+				return false;
+			}
+		}
+		uint64_t c = 0, gap = 0;
+		if(!Varint::get(p, end, c) || c > n) {
+			return false;
+		}
+		removed.resize(c);
+		long last = -1;
+		for(long &uid : removed) {
+			if(!Varint::get(p, end, gap)) {
+				return false;
+			}
+			uid = last += long(gap);
+		}
+		if(!Varint::get(p, end, c) || c > n) {
+			return false;
+		}
+		bodies.resize(c);
+		last = -1;
+		for(StreamBody &b : bodies) {
+			if(!Varint::get(p, end, gap)) {
+				return false;
+			}
+			b.uid = last += long(gap);
+			if(!(get(p, end, b.kind) && get(p, end, b.dir) && get(p, end, b.size) && get(p, end, b.x) && get(p, end, b.y))) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+struct StreamHeader {
+	char magic[8];
+	uint64_t capacity;
+	double width, height;
+	// absolute byte positions: `begin` is the end of the record being written, `head` of the
+	// last complete one, `key` the start of the last keyframe
+	std::atomic<uint64_t> begin, head, key;
+	std::atomic<uint32_t> closed;
+};
+
+struct StreamRecord {
+	uint32_t size;
+	uint32_t type;
+	uint64_t frame;
+};
+
+// Single-producer ring of frames in POSIX shared memory, read by any number of processes.
+// The producer never waits for readers: it overwrites the oldest records, and a reader that
+// was lapped notices it after copying a record (as with a seqlock) and resumes at the last
+// keyframe. Records are 16-byte aligned and never wrap, the tail of the ring is padded.
+class StreamRing {
+private:
+	std::string name;
+	bool owner = false;
+	size_t length = 0;
+	char *base = nullptr;
+	
+	StreamHeader *header = nullptr;
+	char *data = nullptr;
+	uint64_t capacity = 0;
+	
+	// the created ring, rings attached to are owned by another process
+	MemoryCharge memory = MemoryCharge(MEM_STREAM);
+	
+	static uint64_t align(uint64_t n) {
+		return (n + 15) & ~uint64_t(15);
+	}
+
+public:
+	uint64_t frames = 0, dropped = 0;
+	
+	// creates the ring, replacing a stale one of the same name
+	StreamRing(const char *n, size_t cap, const vec2 &ws) : name(n), owner(true) {
+		capacity = align(cap);
+		length = align(sizeof(StreamHeader)) + capacity;
+		shm_unlink(n);
+		int fd = shm_open(n, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if(fd < 0) {
+			return;
+		}
+		if(ftruncate(fd, length) == 0) {
+			void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			base = p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+		}
+		close(fd);
+		if(base == nullptr) {
+			shm_unlink(n);
+			return;
+		}
+		header = reinterpret_cast<StreamHeader*>(base);
+		data = base + align(sizeof(StreamHeader));
+		header->capacity = capacity;
+		header->width = ws.x();
+		header->height = ws.y();
+		header->begin = 0;
+		header->head = 0;
+		header->key = ~uint64_t(0);
+		header->closed = 0;
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(header->magic, STREAM_MAGIC, 8);
+		memory.set(length);
+	}
+	
+	// attaches to an existing ring for reading
+	StreamRing(const char *n) : name(n) {
+		int fd = shm_open(n, O_RDONLY, 0);
+		if(fd < 0) {
+			return;
+		}
+		struct stat st;
+		if(fstat(fd, &st) == 0 && size_t(st.st_size) > sizeof(StreamHeader)) {
+			length = st.st_size;
+			void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+			base = p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+		}
+		close(fd);
+		if(base == nullptr) {
+			return;
+		}
+		header = reinterpret_cast<StreamHeader*>(base);
+		data = base + align(sizeof(StreamHeader));
+		capacity = header->capacity;
+		if(memcmp(header->magic, STREAM_MAGIC, 8) != 0 || align(sizeof(StreamHeader)) + capacity > length) {
+			munmap(base, length);
+			base = nullptr;
+			header = nullptr;
+		}
+	}
+	
+	~StreamRing() {
+		if(base != nullptr) {
+			if(owner && header != nullptr) {
+				header->closed = 1;
+				shm_unlink(name.c_str());
+			}
+			munmap(base, length);
+		}
+	}
+	
+	bool good() const {
+		return header != nullptr;
+	}
+	
+	const StreamHeader &info() const {
+		return *header;
+	}
+	
+	vec2 world_size() const {
+		return vec2(header->width, header->height);
+	}
+	
+	bool write(int type, const std::vector<char> &payload) {
+		uint64_t need = align(sizeof(StreamRecord) + payload.size());
+		if(need > capacity/2) {
+			dropped += 1;
+			return false;
+		}
+		uint64_t pos = header->head.load(std::memory_order_relaxed);
+		uint64_t off = pos % capacity, pad = 0;
+		if(off + need > capacity) {
+			pad = capacity - off;
+		}
+		header->begin.store(pos + pad + need, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		
+		if(pad > 0) {
+			StreamRecord r = {uint32_t(pad), STREAM_PAD, frames};
+			memcpy(data + off, &r, sizeof(r));
+			pos += pad;
+			off = 0;
+		}
+		StreamRecord r = {uint32_t(need), uint32_t(type), frames};
+		memcpy(data + off, &r, sizeof(r));
+		memcpy(data + off + sizeof(r), payload.data(), payload.size());
+		
+		header->head.store(pos + need, std::memory_order_release);
+		if(type == STREAM_KEY) {
+			header->key.store(pos, std::memory_order_release);
+		}
+		frames += 1;
+		return true;
+	}
+	
+	// copies the record at absolute position `pos`, false if it was overwritten meanwhile
+	bool read(uint64_t pos, StreamRecord &r, std::vector<char> &payload) const {
+		uint64_t off = pos % capacity;
+		memcpy(&r, data + off, sizeof(r));
+		bool ok = r.size >= sizeof(r) && r.size % 16 == 0 && off + r.size <= capacity;
+		if(ok && r.type != STREAM_PAD) {
+			payload.assign(data + off + sizeof(r), data + off + r.size);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return ok && header->begin.load(std::memory_order_relaxed) <= pos + capacity;
+	}
+};
+
+// Follows a ring from the last keyframe on; falls back to the latest keyframe when lapped.
+class StreamReader {
+private:
+	StreamRing *ring = nullptr;
+	std::string name;
+	uint64_t pos = 0;
+	bool synced = false;
+	std::vector<char> payload;
+
+public:
+	// frames that were overwritten before they could be read
+	uint64_t lost = 0;
+	uint64_t last_frame = 0;
+	
+	StreamReader(const char *n) : name(n) {}
+	
+	~StreamReader() {
+		detach();
+	}
+	
+	bool attach() {
+		detach();
+		last_frame = 0;
+		ring = new StreamRing(name.c_str());
+		if(!ring->good()) {
+			detach();
+			return false;
+		}
+		return true;
+	}
+	
+	void detach() {
+		delete ring;
+		ring = nullptr;
+		synced = false;
+	}
+	
+	bool attached() const {
+		return ring != nullptr;
+	}
+	
+	// the producer has shut down
+	bool closed() const {
+		return ring != nullptr && ring->info().closed != 0;
+	}
+	
+	vec2 world_size() const {
+		return ring->world_size();
+	}
+	
+	// next frame in order, a keyframe first after attaching or falling behind
+	bool next(StreamFrame &f) {
+		if(ring == nullptr) {
+			return false;
+		}
+		const StreamHeader &h = ring->info();
+		bool resync = false;
+		for(;;) {
+			if(!synced) {
+				if(resync) {
+					return false;
+				}
+				uint64_t k = h.key.load(std::memory_order_acquire);
+				if(k == ~uint64_t(0)) {
+					return false;
+				}
+				pos = k;
+				synced = true;
+				resync = true;
+			}
+			uint64_t head = h.head.load(std::memory_order_acquire);
+			if(pos >= head) {
+				return false;
+			}
+			StreamRecord r;
+			if(head - pos > h.capacity || !ring->read(pos, r, payload)) {
+				synced = false;
+				continue;
+			}
+			pos += r.size;
+			if(r.type == STREAM_PAD) {
+				continue;
+			}
+			if(resync && r.type != STREAM_KEY) {
+				synced = false;
+				continue;
+			}
+			if(!f.decode(r.type, payload.data(), payload.size())) {
+				synced = false;
+				continue;
+			}
+			if(last_frame > 0 && r.frame > last_frame + 1) {
+				lost += r.frame - last_frame - 1;
+			}
+			last_frame = r.frame;
+			return true;
+		}
+	}
+};
+
+// Publishes the world to a ring after steps, at most `fps` frames per wall-clock second,
+// so a fast simulation only pays for the frames a viewer can show.
+class StreamPublisher : public Listener {
+private:
+	typedef std::chrono::steady_clock Clock;
+	
+	const MyWorld &world;
+	StreamRing ring;
+	Clock::time_point last;
+	bool started = false;
+	
+	// the previous frame did not make it into the ring
+	bool broken = false;
+	std::vector<StreamBody> prev, cur;
+	StreamFrame frame;
+	std::vector<char> buffer;
+
+public:
+	double fps = 60.0;
+	// every n-th frame is a keyframe, so viewers can attach at any time
+	int key_period = 30;
+	
+	StreamPublisher(const MyWorld &w, const char *name, size_t capacity = size_t(16) << 20) :
+		world(w), ring(name, capacity, w.size) {}
+	
+	bool good() const {
+		return ring.good();
+	}
+	
+	void stepped(long step) override {
+		Clock::time_point now = Clock::now();
+		if(started && std::chrono::duration<double>(now - last).count() < 1.0/fps) {
+			return;
+		}
+		started = true;
+		last = now;
+		publish(step);
+	}
+	
+	void publish(long step) {
+		cur.clear();
+		for(auto &p : world.entities) {
+			cur.push_back(StreamBody::make(static_cast<const Organism*>(p.second), world.size));
+		}
+		if(!std::is_sorted(cur.begin(), cur.end(), [](const StreamBody &a, const StreamBody &b) {return a.uid < b.uid;})) {
+			std::sort(cur.begin(), cur.end(), [](const StreamBody &a, const StreamBody &b) {return a.uid < b.uid;});
+		}
+		
+		frame.step = step;
+		const Kind kinds[3] = {KIND_PLANT, KIND_HERBIVORE, KIND_CARNIVORE};
+		for(int i = 0; i < 3; ++i) {
+			const SpeciesStats &s = world.stats[kinds[i]];
+			StreamSpecies &fs = frame.species[i];
+			fs.count = s.count;
+			fs.oldest = s.ages.oldest(world.stats.step);
+			fs.energy = s.energy;
+			fs.birth_rate = s.birth_rate;
+			fs.death_rate = s.death_rate;
+		}
+		frame.removed.clear();
+		frame.bodies.clear();
+		if(broken || ring.frames % key_period == 0) {
+			frame.type = STREAM_KEY;
+			frame.bodies = cur;
+		} else {
+			frame.type = STREAM_DELTA;
+			size_t i = 0, j = 0;
+			while(i < prev.size() || j < cur.size()) {
+				if(j >= cur.size() || (i < prev.size() && prev[i].uid < cur[j].uid)) {
+					frame.removed.push_back(prev[i++].uid);
+				} else if(i >= prev.size() || cur[j].uid < prev[i].uid) {
+					frame.bodies.push_back(cur[j++]);
+				} else {
+					if(prev[i] != cur[j]) {
+						frame.bodies.push_back(cur[j]);
+					}
+					++i;
+					++j;
+				}
+			}
+		}
+		frame.encode(buffer);
+		broken = !ring.write(frame.type, buffer);
+		prev.swap(cur);
+	}
+};
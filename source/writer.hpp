@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "memory.hpp"
+
+// Buffered file output, full buffers are written by a background thread.
+// At most two buffers exist at a time, so the producer only waits when the disk falls behind.
+// A failed write is remembered and reported by good() and close().
+class AsyncWriter {
+private:
+	FILE *file = nullptr;
+	size_t capacity;
+	
+	std::vector<char> front, back;
+	bool pending = false, closing = false;
+	std::atomic<bool> failed;
+	
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread thread;
+	
+	MemoryCharge memory = MemoryCharge(MEM_RECORDERS);
+	
+	void loop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			cond.wait(lock, [this](){return pending || closing;});
+			if(!pending) {
+				break;
+			}
+			lock.unlock();
+			if(fwrite(back.data(), 1, back.size(), file) != back.size() || fflush(file) != 0) {
+				failed = true;
+			}
+			lock.lock();
+			back.clear();
+			// a handed over block is dropped rather than kept as a buffer
+			if(back.capacity() > capacity) {
+				std::vector<char>().swap(back);
+				back.reserve(capacity);
+				memory.set(2*capacity);
+			}
+			pending = false;
+			cond.notify_all();
+		}
+	}
+	
+	// waits until the background thread is done with the previous buffer
+	void idle(std::unique_lock<std::mutex> &lock) {
+		if(pending) {
+			stalls += 1;
+			cond.wait(lock, [this](){return !pending;});
+		}
+	}
+	
+	void swap() {
+		std::unique_lock<std::mutex> lock(mutex);
+		idle(lock);
+		if(front.empty()) {
+			return;
+		}
+		std::swap(front, back);
+		pending = true;
+		cond.notify_all();
+	}
+	
+public:
+	// times the producer waited for the background thread
+	long stalls = 0;
+	
+	AsyncWriter(const char *path, size_t cap = 1 << 20) : failed(false) {
+		capacity = cap;
+		front.reserve(capacity);
+		back.reserve(capacity);
+		memory.set(2*capacity);
+		file = fopen(path, "wb");
+		if(file != nullptr) {
+			thread = std::thread([this](){loop();});
+		}
+	}
+	
+	~AsyncWriter() {
+		close();
+	}
+	
+	// false once a write has failed
+	bool good() const {
+		return file != nullptr && !failed;
+	}
+	
+	// writes out what is queued and closes the file, false if any write failed
+	bool close() {
+		if(file == nullptr) {
+			return false;
+		}
+		swap();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+			cond.notify_all();
+		}
+		thread.join();
+		bool ok = fclose(file) == 0 && !failed;
+		file = nullptr;
+		return ok;
+	}
+	
+	// bytes queued and not yet handed to the disk
+	size_t buffered() const {
+		return front.size();
+	}
+	
+	void write(const void *data, size_t size) {
+		if(file == nullptr) {
+			return;
+		}
+		const char *p = static_cast<const char*>(data);
+		front.insert(front.end(), p, p + size);
+		if(front.size() >= capacity) {
+			swap();
+		}
+	}
+	
+	// hands a whole block to the background thread without copying it, after the bytes
+	// queued before it
+	void write(std::vector<char> &&block) {
+		if(file == nullptr || block.empty()) {
+			return;
+		}
+		swap();
+		std::unique_lock<std::mutex> lock(mutex);
+		idle(lock);
+		back.swap(block);
+		if(back.capacity() > capacity) {
+			memory.set(capacity + back.capacity());
+		}
+		pending = true;
+		cond.notify_all();
+	}
+	
+	void flush() {
+		if(file == nullptr) {
+			return;
+		}
+		swap();
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this](){return !pending;});
+	}
+};